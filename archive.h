@@ -0,0 +1,196 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utils.h"
+
+// Single file holding every asset: a header, the entry index, the names, then each blob aligned so it can be used
+// in place once mapped. Textures are stored as KTX2 in the format they are uploaded with
+//
+// | ArchiveHeader | ArchiveEntry[entryCount] | names | padding | blob | padding | blob | ...
+constexpr char ARCHIVE_MAGIC[8] = {'T', 'H', 'A', 'R', 'C', 'H', 'I', 'V'};
+constexpr uint32_t ARCHIVE_VERSION = 1;
+
+// Covers SPIR-V words, texel blocks and optimalBufferCopyOffsetAlignment on common devices
+constexpr uint64_t ARCHIVE_ALIGNMENT = 256;
+
+enum class AssetType : uint32_t {
+	SpirV = 0,
+	Texture = 1,
+	Script = 2,
+};
+
+struct ArchiveHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t entryCount;
+	uint64_t namesOffset, namesSize;
+};
+
+struct ArchiveEntry {
+	uint64_t offset, size;
+	uint32_t nameOffset, nameLength;
+	AssetType type;
+	uint32_t reserved;
+};
+
+static_assert(sizeof(ArchiveHeader) == 32);
+static_assert(sizeof(ArchiveEntry) == 32);
+
+// Read-only mapping of an archive, assets are spans into the mapping so nothing is read until it is touched
+class Archive {
+  public:
+	struct Asset {
+		AssetType type;
+		std::span<const uint8_t> data;
+	};
+
+	Archive() = default;
+	Archive(const Archive &) = delete;
+	Archive &operator=(const Archive &) = delete;
+	~Archive() { close(); }
+
+	// Returns false if the file does not exist, a malformed archive is an error
+	bool open(const std::string &path) {
+		const int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0) return false;
+
+		struct stat status;
+		const bool hasSize = fstat(fd, &status) == 0 && status.st_size > 0;
+		if (hasSize) {
+			mappedSize = static_cast<size_t>(status.st_size);
+			void *mapping = mmap(nullptr, mappedSize, PROT_READ, MAP_PRIVATE, fd, 0);
+			mapped = mapping == MAP_FAILED ? nullptr : static_cast<const uint8_t *>(mapping);
+		}
+		::close(fd);
+		VALIDATE(mapped, "Failed to map archive: " + path);
+
+		VALIDATE(mappedSize >= sizeof(ArchiveHeader), "Archive is too small: " + path);
+		const auto *header = reinterpret_cast<const ArchiveHeader *>(mapped);
+		VALIDATE(memcmp(header->magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC)) == 0, "Not an archive: " + path);
+		VALIDATE(header->version == ARCHIVE_VERSION, "Unsupported archive version: " + path);
+		VALIDATE(sizeof(ArchiveHeader) + header->entryCount * sizeof(ArchiveEntry) <= mappedSize &&
+					 header->namesOffset + header->namesSize <= mappedSize,
+				 "Truncated archive index: " + path);
+
+		const auto *entries = reinterpret_cast<const ArchiveEntry *>(mapped + sizeof(ArchiveHeader));
+		const char *names = reinterpret_cast<const char *>(mapped + header->namesOffset);
+		for (uint32_t i = 0; i < header->entryCount; ++i) {
+			const ArchiveEntry &entry = entries[i];
+			VALIDATE(entry.offset + entry.size <= mappedSize &&
+						 entry.nameOffset + entry.nameLength <= header->namesSize,
+					 "Archive entry out of bounds: " + path);
+			index.emplace(std::string_view(names + entry.nameOffset, entry.nameLength), &entry);
+		}
+
+		LOG("Mapped archive " << path << ": " << header->entryCount << " assets, " << mappedSize << " bytes");
+		return true;
+	}
+
+	void close() {
+		if (!mapped) return;
+
+		index.clear();
+		munmap(const_cast<uint8_t *>(mapped), mappedSize);
+		mapped = nullptr;
+		mappedSize = 0;
+	}
+
+	bool isOpen() const { return mapped; }
+
+	std::optional<Asset> find(const std::string_view name) const {
+		const auto it = index.find(name);
+		if (it == index.end()) return std::nullopt;
+
+		const ArchiveEntry &entry = *it->second;
+		return Asset{entry.type, {mapped + entry.offset, static_cast<size_t>(entry.size)}};
+	}
+
+  private:
+	const uint8_t *mapped = nullptr;
+	size_t mappedSize = 0;
+	// Keys point into the mapping
+	std::unordered_map<std::string_view, const ArchiveEntry *> index;
+};
+
+// Used by the packer, collects the blobs in memory and lays the file out in one go
+class ArchiveWriter {
+  public:
+	void add(const std::string &name, const AssetType type, list<uint8_t> &&data) {
+		assets.push_back(PendingAsset{name, type, std::move(data)});
+	}
+
+	void write(const std::string &path) const {
+		ArchiveHeader header{};
+		memcpy(header.magic, ARCHIVE_MAGIC, sizeof(ARCHIVE_MAGIC));
+		header.version = ARCHIVE_VERSION;
+		header.entryCount = static_cast<uint32_t>(assets.size());
+		header.namesOffset = sizeof(ArchiveHeader) + assets.size() * sizeof(ArchiveEntry);
+
+		std::string names;
+		list<ArchiveEntry> entries;
+		for (const PendingAsset &asset : assets) {
+			entries.push_back(ArchiveEntry{
+				.offset = 0,
+				.size = asset.data.size(),
+				.nameOffset = static_cast<uint32_t>(names.size()),
+				.nameLength = static_cast<uint32_t>(asset.name.size()),
+				.type = asset.type,
+				.reserved = 0,
+			});
+			names += asset.name;
+		}
+		header.namesSize = names.size();
+
+		uint64_t offset = header.namesOffset + header.namesSize;
+		for (ArchiveEntry &entry : entries) {
+			offset = alignUp(offset);
+			entry.offset = offset;
+			offset += entry.size;
+		}
+
+		std::ofstream file(path, std::ios::binary | std::ios::trunc);
+		VALIDATE(file.is_open(), "Failed to create archive: " + path);
+
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char *>(entries.data()),
+				   static_cast<std::streamsize>(entries.size() * sizeof(ArchiveEntry)));
+		file.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+		uint64_t written = header.namesOffset + header.namesSize;
+		for (size_t i = 0; i < assets.size(); ++i) {
+			const list<char> padding(entries[i].offset - written, 0);
+			file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+			file.write(reinterpret_cast<const char *>(assets[i].data.data()),
+					   static_cast<std::streamsize>(assets[i].data.size()));
+			written = entries[i].offset + entries[i].size;
+		}
+
+		VALIDATE(file.good(), "Failed to write archive: " + path);
+	}
+
+  private:
+	struct PendingAsset {
+		std::string name;
+		AssetType type;
+		list<uint8_t> data;
+	};
+
+	list<PendingAsset> assets;
+
+	static uint64_t alignUp(const uint64_t offset) {
+		return (offset + ARCHIVE_ALIGNMENT - 1) & ~(ARCHIVE_ALIGNMENT - 1);
+	}
+};
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory_resource>
+
+#include "utils.h"
+
+// Bump allocator for data that only lives until the end of the frame, reset at the start of the next one. Freeing is
+// a no-op. Render thread only. When the buffer runs out, allocations fall back to the heap and are counted, so the
+// capacity can be raised rather than the frame silently allocating
+class FrameArena : public std::pmr::memory_resource {
+  public:
+	explicit FrameArena(const size_t capacity) : buffer(capacity) {}
+
+	// Everything allocated since the last reset must be gone by now
+	void reset() {
+		peak = std::max(peak, offset);
+		offset = 0;
+	}
+
+	size_t getPeak() const { return std::max(peak, offset); }
+	uint64_t getOverflowCount() const { return overflowCount; }
+
+  private:
+	list<std::byte> buffer;
+	size_t offset = 0, peak = 0;
+	uint64_t overflowCount = 0;
+
+	void *do_allocate(const size_t bytes, const size_t alignment) override {
+		const size_t start = (offset + alignment - 1) & ~(alignment - 1);
+		if (start + bytes > buffer.size()) {
+			++overflowCount;
+			return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+		}
+
+		offset = start + bytes;
+		return buffer.data() + start;
+	}
+
+	void do_deallocate(void *pointer, const size_t bytes, const size_t alignment) override {
+		const std::byte *bytePointer = static_cast<std::byte *>(pointer);
+		if (bytePointer < buffer.data() || bytePointer >= buffer.data() + buffer.size()) {
+			std::pmr::new_delete_resource()->deallocate(pointer, bytes, alignment);
+		}
+	}
+
+	bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override { return this == &other; }
+};
@@ -0,0 +1,152 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "bullets.h"
+#include "pipeline.h"
+#include "utils.h"
+
+// Incremented by the global operator new replacements of the engine, so the benchmark can tell how many heap
+// allocations a frame made. Relaxed, only the difference between two reads on the same thread matters
+inline std::atomic<uint64_t> allocationCount = 0;
+
+// Scripted scene rendered by the benchmark, sprites are spread over the same quad geometry and cycle through the
+// textures and pipeline variants so state changes scale with the counts
+struct BenchScene {
+	const char *name;
+	uint32_t spriteCount;
+	uint32_t textureCount;
+	uint32_t pipelineCount;
+	// Frames between two swapchain resizes, 0 to keep the extent
+	uint32_t resizeInterval;
+};
+
+constexpr uint32_t BENCH_WARMUP_FRAMES = 30;
+constexpr uint32_t BENCH_FRAMES = 300;
+
+constexpr BenchScene BENCH_SCENES[] = {
+	{"sprites1k", 1'000, 1, 1, 0},
+	{"sprites10k", 10'000, 1, 1, 0},
+	{"sprites100k", 100'000, 1, 1, 0},
+	{"textures", 10'000, 64, 1, 0},
+	{"blendModes", 10'000, 1, 16, 0},
+	{"resizeStorm", 1'000, 1, 1, 4},
+};
+
+// Every blend mode, with and without color multiply and alpha test
+inline PipelineKey getBenchPipelineKey(const uint32_t index) {
+	return PipelineKey{
+		.blendMode = static_cast<BlendMode>(index % BLEND_MODE_COUNT),
+		.colorMultiply = (index / BLEND_MODE_COUNT) % 2 == 1,
+		.uvScale = 1.0f,
+		.alphaTest = (index / BLEND_MODE_COUNT / 2) % 2 == 1,
+		.uvDebug = false,
+	};
+}
+
+// Deterministic, so every run draws the same scene
+class BenchRandom {
+  public:
+	explicit BenchRandom(const uint32_t seed) : state(seed) {}
+
+	// In [0, 1)
+	float next() {
+		state = state * 1664525u + 1013904223u;
+		return static_cast<float>(state >> 8) / static_cast<float>(1u << 24);
+	}
+
+  private:
+	uint32_t state;
+};
+
+struct FrameSample {
+	double frameMilliseconds;
+	double recordMilliseconds;
+	uint64_t allocations;
+};
+
+struct BenchResult {
+	std::string scene;
+	list<FrameSample> samples;
+};
+
+// Bullet counts the rollback snapshot save and restore are timed at, the cost bounds how many ticks a frame can
+// resimulate
+constexpr uint32_t SNAPSHOT_BENCH_BULLETS[] = {1'000, 10'000, MAX_BULLETS};
+constexpr uint32_t SNAPSHOT_BENCH_ITERATIONS = 300;
+
+// Two rollback sessions on a loopback transport, with random inputs changing every few ticks
+constexpr uint32_t LOOPBACK_BENCH_TICKS = 1'800;
+constexpr uint32_t LOOPBACK_BENCH_LATENCY = 4;
+
+struct SnapshotBenchResult {
+	uint32_t bulletCount;
+	size_t snapshotSize;
+	list<double> saveMilliseconds, restoreMilliseconds;
+};
+
+struct LoopbackBenchResult {
+	list<double> tickMilliseconds;
+	uint64_t rollbacks, resimulatedTicks;
+	// Both sides ended on the state of a simulation fed the real inputs
+	bool inSync;
+};
+
+// Nearest rank, values is sorted in place
+inline double getPercentile(list<double> &values, const double percentile) {
+	if (values.empty()) return 0.0;
+
+	std::sort(values.begin(), values.end());
+	const size_t rank = static_cast<size_t>(percentile / 100.0 * static_cast<double>(values.size() - 1) + 0.5);
+	return values[std::min(rank, values.size() - 1)];
+}
+
+inline void writeDistribution(std::ostream &out, list<double> &values) {
+	out << "{\"p50\":" << getPercentile(values, 50.0) << ",\"p99\":" << getPercentile(values, 99.0)
+		<< ",\"max\":" << (values.empty() ? 0.0 : values.back()) << "}";
+}
+
+// Single JSON document, all times in milliseconds
+inline void writeBenchReport(std::ostream &out, const std::string &device, const list<BenchResult> &results,
+							 list<SnapshotBenchResult> &snapshots, LoopbackBenchResult &loopback) {
+	out << "{\"device\":\"" << device << "\",\"scenes\":[";
+	for (size_t i = 0; i < results.size(); ++i) {
+		const BenchResult &result = results[i];
+
+		list<double> frameTimes, recordTimes, allocations;
+		for (const FrameSample &sample : result.samples) {
+			frameTimes.push_back(sample.frameMilliseconds);
+			recordTimes.push_back(sample.recordMilliseconds);
+			allocations.push_back(static_cast<double>(sample.allocations));
+		}
+
+		out << (i ? "," : "") << "{\"name\":\"" << result.scene << "\",\"frames\":" << result.samples.size()
+			<< ",\"frameTime\":";
+		writeDistribution(out, frameTimes);
+		out << ",\"recordTime\":";
+		writeDistribution(out, recordTimes);
+		out << ",\"allocationsPerFrame\":";
+		writeDistribution(out, allocations);
+		out << "}";
+	}
+
+	out << "],\"snapshots\":[";
+	for (size_t i = 0; i < snapshots.size(); ++i) {
+		out << (i ? "," : "") << "{\"bullets\":" << snapshots[i].bulletCount << ",\"size\":"
+			<< snapshots[i].snapshotSize << ",\"saveTime\":";
+		writeDistribution(out, snapshots[i].saveMilliseconds);
+		out << ",\"restoreTime\":";
+		writeDistribution(out, snapshots[i].restoreMilliseconds);
+		out << "}";
+	}
+
+	out << "],\"loopback\":{\"latency\":" << LOOPBACK_BENCH_LATENCY << ",\"rollbacks\":" << loopback.rollbacks
+		<< ",\"resimulatedTicks\":" << loopback.resimulatedTicks
+		<< ",\"inSync\":" << (loopback.inSync ? "true" : "false") << ",\"tickTime\":";
+	writeDistribution(out, loopback.tickMilliseconds);
+	out << "}}" << std::endl;
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+#include "fixed.h"
+#include "utils.h"
+
+// Playfield in simulation units, centered on the origin. Bullets leaving it are removed
+constexpr Fixed PLAYFIELD_HALF_WIDTH = Fixed::fromInt(192);
+constexpr Fixed PLAYFIELD_HALF_HEIGHT = Fixed::fromInt(224);
+// Bullets may be spawned slightly outside and still fly in
+constexpr Fixed PLAYFIELD_MARGIN = Fixed::fromInt(32);
+
+constexpr uint32_t MAX_BULLETS = 1 << 16;
+// The update runs over whole blocks of lanes, so the vectorized loop needs no scalar remainder
+constexpr uint32_t BULLET_BLOCK = 8;
+
+static_assert(MAX_BULLETS % BULLET_BLOCK == 0);
+
+// Structure of arrays of raw Q16.16 values, so the per tick update is a run of independent integer adds over
+// contiguous memory. Storage is allocated once, spawning past the capacity drops the bullet
+class BulletSystem {
+  public:
+	BulletSystem() {
+		for (list<int32_t> *component : {&positionX, &positionY, &velocityX, &velocityY}) {
+			component->assign(MAX_BULLETS, 0);
+		}
+	}
+
+	uint32_t size() const { return count; }
+	FixedVec2 getPosition(const uint32_t index) const {
+		return {Fixed::fromRaw(positionX[index]), Fixed::fromRaw(positionY[index])};
+	}
+
+	void spawn(const FixedVec2 position, const FixedVec2 velocity) {
+		if (count == MAX_BULLETS) return;
+
+		positionX[count] = position.x.raw;
+		positionY[count] = position.y.raw;
+		velocityX[count] = velocity.x.raw;
+		velocityY[count] = velocity.y.raw;
+		++count;
+	}
+
+	// count bullets evenly spread around the circle, the first one at angle
+	void spawnRing(const FixedVec2 center, const uint32_t count, const Angle angle, const Fixed speed) {
+		for (uint32_t i = 0; i < count; ++i) {
+			spawn(center, fromAngle(static_cast<Angle>(angle + i * 65536 / count), speed));
+		}
+	}
+
+	void spawnAimed(const FixedVec2 origin, const FixedVec2 target, const Fixed speed) {
+		const FixedVec2 direction = target - origin;
+		spawn(origin, fromAngle(fixedAtan2(direction.y, direction.x), speed));
+	}
+
+	void update() {
+		// GCC only vectorizes at -O2 without aliasing checks or a remainder loop: the components never alias, and the
+		// lanes past the last bullet have no velocity, updating them changes nothing
+		int32_t *x = positionX.data(), *y = positionY.data();
+		const int32_t *vx = velocityX.data(), *vy = velocityY.data();
+		const uint32_t laneCount = (count + BULLET_BLOCK - 1) / BULLET_BLOCK * BULLET_BLOCK;
+#pragma GCC ivdep
+		for (uint32_t i = 0; i < laneCount; ++i) {
+			x[i] += vx[i];
+			y[i] += vy[i];
+		}
+
+		// Swap with the last bullet, the order changes but stays the same on every machine
+		const int32_t maxX = (PLAYFIELD_HALF_WIDTH + PLAYFIELD_MARGIN).raw;
+		const int32_t maxY = (PLAYFIELD_HALF_HEIGHT + PLAYFIELD_MARGIN).raw;
+		for (uint32_t i = 0; i < count;) {
+			if (positionX[i] < -maxX || positionX[i] > maxX || positionY[i] < -maxY || positionY[i] > maxY) {
+				remove(i);
+			} else {
+				++i;
+			}
+		}
+	}
+
+	// Only the live lanes are copied, the count and 16 bytes per bullet
+	static constexpr size_t MAX_SNAPSHOT_SIZE = sizeof(uint32_t) + 4 * MAX_BULLETS * sizeof(int32_t);
+
+	// Returns the end of the snapshot
+	uint8_t *save(uint8_t *out) const {
+		memcpy(out, &count, sizeof(count));
+		out += sizeof(count);
+		for (const list<int32_t> *component : {&positionX, &positionY, &velocityX, &velocityY}) {
+			memcpy(out, component->data(), count * sizeof(int32_t));
+			out += count * sizeof(int32_t);
+		}
+		return out;
+	}
+
+	const uint8_t *restore(const uint8_t *in) {
+		const uint32_t previousCount = count;
+		memcpy(&count, in, sizeof(count));
+		in += sizeof(count);
+		for (list<int32_t> *component : {&positionX, &positionY, &velocityX, &velocityY}) {
+			memcpy(component->data(), in, count * sizeof(int32_t));
+			in += count * sizeof(int32_t);
+			// Lanes past the last bullet have to stay still
+			if (previousCount > count) {
+				memset(component->data() + count, 0, (previousCount - count) * sizeof(int32_t));
+			}
+		}
+		return in;
+	}
+
+	// FNV-1a over the words of the live state, equal on two machines only if their simulations did not diverge
+	uint64_t getChecksum() const {
+		uint64_t hash = 0xCBF29CE484222325u;
+		for (const list<int32_t> *component : {&positionX, &positionY, &velocityX, &velocityY}) {
+			for (uint32_t i = 0; i < count; ++i) {
+				hash = (hash ^ static_cast<uint32_t>((*component)[i])) * 0x100000001B3u;
+			}
+		}
+		return hash;
+	}
+
+  private:
+	list<int32_t> positionX, positionY, velocityX, velocityY;
+	uint32_t count = 0;
+
+	void remove(const uint32_t index) {
+		--count;
+		for (list<int32_t> *component : {&positionX, &positionY, &velocityX, &velocityY}) {
+			(*component)[index] = (*component)[count];
+			(*component)[count] = 0;
+		}
+	}
+};
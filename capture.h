@@ -0,0 +1,184 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "png.h"
+#include "readback.h"
+#include "utils.h"
+
+enum class CaptureFormat {
+	// Raw 4:2:0 video in a single file, readable by ffmpeg and most players
+	Y4m,
+	// Numbered PNG per frame in a directory
+	PngSequence,
+};
+
+constexpr uint32_t CAPTURE_FRAME_RATE = 60;
+
+// Full range BT.601, with chroma averaged over each 2x2 block
+inline void writeY4mFrame(std::ostream &out, const uint8_t *rgba, const uint32_t width, const uint32_t height) {
+	const auto luma = [](const uint8_t *p) {
+		return static_cast<uint8_t>(std::clamp(0.299f * p[0] + 0.587f * p[1] + 0.114f * p[2] + 0.5f, 0.0f, 255.0f));
+	};
+
+	list<uint8_t> planes(static_cast<size_t>(width) * height + 2 * static_cast<size_t>((width + 1) / 2) *
+																	  ((height + 1) / 2));
+	uint8_t *y = planes.data();
+	uint8_t *u = y + static_cast<size_t>(width) * height;
+	uint8_t *v = u + static_cast<size_t>((width + 1) / 2) * ((height + 1) / 2);
+
+	for (uint32_t row = 0; row < height; ++row) {
+		for (uint32_t column = 0; column < width; ++column) {
+			*y++ = luma(rgba + (static_cast<size_t>(row) * width + column) * 4);
+		}
+	}
+
+	for (uint32_t row = 0; row < height; row += 2) {
+		for (uint32_t column = 0; column < width; column += 2) {
+			float r = 0.0f, g = 0.0f, b = 0.0f;
+			for (uint32_t dy = 0; dy < 2; ++dy) {
+				for (uint32_t dx = 0; dx < 2; ++dx) {
+					// Odd sizes repeat the last row or column
+					const uint32_t sampleRow = std::min(row + dy, height - 1);
+					const uint32_t sampleColumn = std::min(column + dx, width - 1);
+					const uint8_t *p = rgba + (static_cast<size_t>(sampleRow) * width + sampleColumn) * 4;
+					r += p[0];
+					g += p[1];
+					b += p[2];
+				}
+			}
+			r /= 4.0f;
+			g /= 4.0f;
+			b /= 4.0f;
+
+			const float cb = 128.0f - 0.168736f * r - 0.331264f * g + 0.5f * b;
+			const float cr = 128.0f + 0.5f * r - 0.418688f * g - 0.081312f * b;
+			*u++ = static_cast<uint8_t>(std::clamp(cb + 0.5f, 0.0f, 255.0f));
+			*v++ = static_cast<uint8_t>(std::clamp(cr + 0.5f, 0.0f, 255.0f));
+		}
+	}
+
+	out << "FRAME\n";
+	out.write(reinterpret_cast<const char *>(planes.data()), static_cast<std::streamsize>(planes.size()));
+}
+
+// Encodes captured frames on its own thread, straight from the readback slots they were copied to. The render thread
+// only queues the frames: when the encoder falls behind it holds on to every slot, and the ring drops new captures
+// until one is released
+class VideoEncoder {
+  public:
+	~VideoEncoder() { stop(); }
+
+	bool start(const std::string &path, const CaptureFormat format, ReadbackRing &ring) {
+		this->path = path;
+		this->format = format;
+		this->ring = &ring;
+
+		if (format == CaptureFormat::Y4m) {
+			file.open(path, std::ios::binary);
+			if (!file.is_open()) return false;
+		}
+
+		LOG("Capturing frames to " << path);
+		stopping = false;
+		thread = std::thread([this] { encode(); });
+		return true;
+	}
+
+	// Encodes the frames still queued before returning
+	void stop() {
+		if (!thread.joinable()) return;
+
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		frameAvailable.notify_one();
+		thread.join();
+		file.close();
+	}
+
+	bool isRunning() const { return thread.joinable(); }
+
+	// Render thread, never waits on the encoder. The slot of the frame is released by the encoder thread
+	void submit(const ReadbackFrame &frame) {
+		{
+			std::lock_guard lock(mutex);
+			frames.push_back(frame);
+		}
+		frameAvailable.notify_one();
+	}
+
+	// Only valid once stopped
+	uint64_t getEncodedCount() const { return encodedCount; }
+	uint64_t getSkippedCount() const { return skippedCount; }
+
+  private:
+	std::string path;
+	CaptureFormat format;
+	ReadbackRing *ring = nullptr;
+	std::ofstream file;
+	VkExtent2D extent = {0, 0};
+
+	std::thread thread;
+	std::mutex mutex;
+	std::condition_variable frameAvailable;
+	std::deque<ReadbackFrame> frames;
+	bool stopping = false;
+
+	uint64_t encodedCount = 0, skippedCount = 0;
+
+	void encode() {
+		while (true) {
+			ReadbackFrame frame;
+			{
+				std::unique_lock lock(mutex);
+				frameAvailable.wait(lock, [this] { return stopping || !frames.empty(); });
+				if (frames.empty()) return;
+
+				frame = frames.front();
+				frames.pop_front();
+			}
+
+			encodeFrame(frame);
+			ring->release(frame.slot);
+		}
+	}
+
+	void encodeFrame(const ReadbackFrame &frame) {
+		const size_t pixelCount = static_cast<size_t>(frame.extent.width) * frame.extent.height;
+		const list<uint8_t> rgba = toRgba(frame.pixels, pixelCount, frame.format);
+
+		if (format == CaptureFormat::PngSequence) {
+			char name[32];
+			snprintf(name, sizeof(name), "/frame_%06llu.png", static_cast<unsigned long long>(encodedCount));
+			if (!writePng(path + name, frame.extent.width, frame.extent.height, rgba.data())) {
+				LOGE("Failed to write captured frame " << path << name);
+			}
+			++encodedCount;
+			return;
+		}
+
+		// The stream has a single size, set by the first frame
+		if (encodedCount == 0) {
+			extent = frame.extent;
+			file << "YUV4MPEG2 W" << extent.width << " H" << extent.height << " F" << CAPTURE_FRAME_RATE
+				 << ":1 Ip A1:1 C420jpeg\n";
+		}
+		if (frame.extent.width != extent.width || frame.extent.height != extent.height) {
+			++skippedCount;
+			return;
+		}
+
+		writeY4mFrame(file, rgba.data(), extent.width, extent.height);
+		++encodedCount;
+	}
+};
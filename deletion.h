@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+// Destruction of GPU resources deferred until the timeline value of the last submission using them has completed.
+// Values are pushed in submission order, so collecting only ever looks at the front
+class DeletionQueue {
+  public:
+	void push(const uint64_t timelineValue, std::function<void()> &&destroy) {
+		entries.push_back(Entry{timelineValue, std::move(destroy)});
+	}
+
+	void collect(const uint64_t completedValue) {
+		while (!entries.empty() && entries.front().timelineValue <= completedValue) {
+			entries.front().destroy();
+			entries.pop_front();
+		}
+	}
+
+	// Only valid once the device is idle
+	void flush() {
+		for (auto &entry : entries) {
+			entry.destroy();
+		}
+		entries.clear();
+	}
+
+	size_t size() const { return entries.size(); }
+
+  private:
+	struct Entry {
+		uint64_t timelineValue;
+		std::function<void()> destroy;
+	};
+
+	std::deque<Entry> entries;
+};
@@ -0,0 +1,210 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory_resource>
+#include <span>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "objectcache.h"
+#include "smalllist.h"
+#include "utils.h"
+
+// Sets of the first pool, each pool chained after it holds twice as many up to the maximum
+constexpr uint32_t DESCRIPTOR_POOL_INITIAL_SETS = 64;
+constexpr uint32_t DESCRIPTOR_POOL_MAX_SETS = 4096;
+
+// Allocates sets from a chain of pools, a new one joins whenever the last is full. Sets are not freed one by one,
+// reset gives every set back at once and keeps the pools for the next round
+// Pools are counted full once they hold maxSets sets: allocating past that is invalid usage in Vulkan 1.0, not the
+// VK_ERROR_OUT_OF_POOL_MEMORY of maintenance1
+class DescriptorAllocator {
+  public:
+	// Pool sizes are the descriptors of one set, scaled by the sets a pool holds. Every set allocated must use at
+	// most those descriptors, or a pool could run out before its set count does
+	void create(const VkDevice device, const std::span<const VkDescriptorPoolSize> descriptorsPerSet) {
+		this->device = device;
+		for (const VkDescriptorPoolSize &poolSize : descriptorsPerSet) {
+			this->descriptorsPerSet.push_back(poolSize);
+		}
+	}
+
+	VkDescriptorSet allocate(const VkDescriptorSetLayout layout) {
+		if (currentPool < pools.size() && setsInCurrentPool == pools[currentPool].maxSets) {
+			++currentPool;
+			setsInCurrentPool = 0;
+		}
+		if (currentPool == pools.size()) addPool();
+
+		VkDescriptorSet descriptorSet;
+		VK_CHECK(allocateFrom(pools[currentPool].pool, layout, descriptorSet), "Failed to allocate descriptor set!");
+		++setsInCurrentPool;
+		return descriptorSet;
+	}
+
+	// Every set allocated so far must be done with, on the GPU as well
+	void reset() {
+		for (size_t i = 0; i <= currentPool && i < pools.size(); ++i) {
+			vkResetDescriptorPool(device, pools[i].pool, 0);
+		}
+		currentPool = 0;
+		setsInCurrentPool = 0;
+	}
+
+	void destroy() {
+		for (const Pool &pool : pools) {
+			vkDestroyDescriptorPool(device, pool.pool, VK_NULL_HANDLE);
+		}
+		pools.clear();
+		currentPool = 0;
+		setsInCurrentPool = 0;
+	}
+
+	size_t getPoolCount() const { return pools.size(); }
+
+  private:
+	struct Pool {
+		VkDescriptorPool pool;
+		uint32_t maxSets;
+	};
+
+	VkDevice device = VK_NULL_HANDLE;
+	small_list<VkDescriptorPoolSize, 4> descriptorsPerSet;
+	list<Pool> pools;
+	// Pools before it are full, the ones after it are empty
+	size_t currentPool = 0;
+	uint32_t setsInCurrentPool = 0;
+
+	VkResult allocateFrom(const VkDescriptorPool pool, const VkDescriptorSetLayout layout,
+						  VkDescriptorSet &descriptorSet) {
+		const VkDescriptorSetAllocateInfo allocInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.descriptorPool = pool,
+			.descriptorSetCount = 1,
+			.pSetLayouts = &layout,
+		};
+		return vkAllocateDescriptorSets(device, &allocInfo, &descriptorSet);
+	}
+
+	void addPool() {
+		const uint32_t setCount = std::min(DESCRIPTOR_POOL_INITIAL_SETS << std::min<size_t>(pools.size(), 16),
+										   DESCRIPTOR_POOL_MAX_SETS);
+		LOG("Chaining descriptor pool " << pools.size() << " for " << setCount << " sets");
+
+		small_list<VkDescriptorPoolSize, 4> poolSizes = descriptorsPerSet;
+		for (VkDescriptorPoolSize &poolSize : poolSizes) {
+			poolSize.descriptorCount *= setCount;
+		}
+
+		const VkDescriptorPoolCreateInfo poolInfo{
+			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.maxSets = setCount,
+			.poolSizeCount = static_cast<uint32_t>(poolSizes.size()),
+			.pPoolSizes = poolSizes.data(),
+		};
+
+		VkDescriptorPool pool;
+		VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, VK_NULL_HANDLE, &pool), "Failed to create descriptor pool!");
+		pools.push_back(Pool{pool, setCount});
+	}
+};
+
+// What one binding of a set points to: a buffer range, or an image and sampler, whichever of the two is set
+struct DescriptorBinding {
+	uint32_t binding;
+	VkDescriptorType descriptorType;
+	VkBuffer buffer;
+	VkDeviceSize offset, range;
+	VkSampler sampler;
+	VkImageView imageView;
+	VkImageLayout imageLayout;
+
+	bool operator==(const DescriptorBinding &) const = default;
+};
+
+struct DescriptorSetKey {
+	VkDescriptorSetLayout layout;
+	small_list<DescriptorBinding, 4> bindings;
+
+	bool operator==(const DescriptorSetKey &) const = default;
+};
+
+template <> struct std::hash<DescriptorSetKey> {
+	size_t operator()(const DescriptorSetKey &key) const noexcept {
+		size_t seed = hashFields(key.layout, key.bindings.size());
+		for (const DescriptorBinding &binding : key.bindings) {
+			seed ^= hashFields(binding.binding, binding.descriptorType, binding.buffer, binding.offset, binding.range,
+							   binding.sampler, binding.imageView, binding.imageLayout) +
+					0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
+		return seed;
+	}
+};
+
+// Sets by their contents, allocated and written on the first request only. They live as long as the allocator they
+// came from goes without a reset, which has to reset the cache too
+class DescriptorSetCache {
+  public:
+	// The map allocates from resource, the frame arena for the sets of a frame
+	void reset(const VkDevice device, DescriptorAllocator &allocator, std::pmr::memory_resource *resource) {
+		this->device = device;
+		this->allocator = &allocator;
+		sets = std::pmr::unordered_map<DescriptorSetKey, VkDescriptorSet>(resource);
+	}
+
+	VkDescriptorSet get(const DescriptorSetKey &key) {
+		if (const auto found = sets.find(key); found != sets.end()) return found->second;
+
+		const VkDescriptorSet descriptorSet = allocator->allocate(key.layout);
+		write(descriptorSet, key.bindings);
+		sets.emplace(key, descriptorSet);
+		return descriptorSet;
+	}
+
+	size_t size() const { return sets.size(); }
+
+  private:
+	VkDevice device = VK_NULL_HANDLE;
+	DescriptorAllocator *allocator = nullptr;
+	std::pmr::unordered_map<DescriptorSetKey, VkDescriptorSet> sets;
+
+	void write(const VkDescriptorSet descriptorSet, const small_list<DescriptorBinding, 4> &bindings) {
+		// Sized up front, the writes point into them
+		small_list<VkDescriptorBufferInfo, 4> bufferInfos(bindings.size());
+		small_list<VkDescriptorImageInfo, 4> imageInfos(bindings.size());
+		small_list<VkWriteDescriptorSet, 4> writes(bindings.size());
+		for (size_t i = 0; i < bindings.size(); ++i) {
+			const DescriptorBinding &binding = bindings[i];
+			bufferInfos[i] = VkDescriptorBufferInfo{
+				.buffer = binding.buffer,
+				.offset = binding.offset,
+				.range = binding.range,
+			};
+			imageInfos[i] = VkDescriptorImageInfo{
+				.sampler = binding.sampler,
+				.imageView = binding.imageView,
+				.imageLayout = binding.imageLayout,
+			};
+
+			const bool isBuffer = binding.buffer != VK_NULL_HANDLE;
+			writes[i] = VkWriteDescriptorSet{
+				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+				.pNext = VK_NULL_HANDLE,
+				.dstSet = descriptorSet,
+				.dstBinding = binding.binding,
+				.dstArrayElement = 0,
+				.descriptorCount = 1,
+				.descriptorType = binding.descriptorType,
+				.pImageInfo = isBuffer ? VK_NULL_HANDLE : &imageInfos[i],
+				.pBufferInfo = isBuffer ? &bufferInfos[i] : VK_NULL_HANDLE,
+				.pTexelBufferView = VK_NULL_HANDLE,
+			};
+		}
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, VK_NULL_HANDLE);
+	}
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <type_traits>
+
+#include <vulkan/vulkan.h>
+
+#include "smalllist.h"
+#include "utils.h"
+
+// The two call idiom of vkEnumerate* and vkGet*: function(args..., &count, items) is called for the count, then again
+// into out resized to it. VK_INCOMPLETE means the count grew in between, so it starts over. Any list type works, a
+// small_list sized for the usual count does not allocate at all
+template <typename Items, typename Function, typename... Args>
+VkResult enumerate(Items &out, const Function function, const Args... args) {
+	using Item = std::remove_pointer_t<decltype(out.data())>;
+	while (true) {
+		uint32_t count = 0;
+		if constexpr (std::is_void_v<decltype(function(args..., &count, static_cast<Item *>(nullptr)))>) {
+			function(args..., &count, static_cast<Item *>(nullptr));
+			out.resize(count);
+			function(args..., &count, out.data());
+			out.resize(count);
+			return VK_SUCCESS;
+		} else {
+			VkResult result = function(args..., &count, static_cast<Item *>(nullptr));
+			if (result != VK_SUCCESS) return result;
+
+			out.resize(count);
+			result = function(args..., &count, out.data());
+			out.resize(count);
+			if (result != VK_INCOMPLETE) return result;
+		}
+	}
+}
+
+// Inline capacity for the queue families, more than GPUs usually expose
+constexpr size_t MAX_QUEUE_FAMILIES = 8;
+
+struct QueueFamilyIndices {
+	std::optional<uint32_t> graphicsFamily, presentFamily;
+	// Transfer only family, the DMA engine on most discrete GPUs
+	std::optional<uint32_t> transferFamily;
+
+	bool isComplete() const { return graphicsFamily.has_value() && presentFamily.has_value(); }
+};
+
+struct SwapChainSupportDetails {
+	VkSurfaceCapabilitiesKHR capabilities;
+	pmr_list<VkSurfaceFormatKHR> formats;
+	pmr_list<VkPresentModeKHR> presentModes;
+};
+
+// The lists come from resource, the frame arena when the swapchain is recreated
+inline SwapChainSupportDetails querySwapChainSupport(
+	const VkPhysicalDevice device, const VkSurfaceKHR surface,
+	std::pmr::memory_resource *resource = std::pmr::get_default_resource()) {
+	SwapChainSupportDetails details{
+		.capabilities = {},
+		.formats = pmr_list<VkSurfaceFormatKHR>(resource),
+		.presentModes = pmr_list<VkPresentModeKHR>(resource),
+	};
+	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+	enumerate(details.formats, vkGetPhysicalDeviceSurfaceFormatsKHR, device, surface);
+	enumerate(details.presentModes, vkGetPhysicalDeviceSurfacePresentModesKHR, device, surface);
+	return details;
+}
+
+// Everything device selection and creation need to know about a physical device, queried once per device
+struct DeviceCapabilities {
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkPhysicalDeviceProperties properties;
+	VkPhysicalDeviceFeatures features;
+	VkPhysicalDeviceMemoryProperties memoryProperties;
+	small_list<VkQueueFamilyProperties, MAX_QUEUE_FAMILIES> queueFamilies;
+	// Usually a couple hundred, one allocation per device
+	list<VkExtensionProperties> extensions;
+	QueueFamilyIndices queueFamilyIndices;
+	SwapChainSupportDetails swapChainSupport;
+
+	bool hasRequiredExtensions = false;
+	VkDeviceSize deviceLocalMemory = 0;
+	bool supportsTimestamps = false;
+
+	bool hasExtension(const char *name) const {
+		return std::any_of(extensions.begin(), extensions.end(), [&](const VkExtensionProperties &extension) {
+			return IS_STR_EQUAL(extension.extensionName, name);
+		});
+	}
+
+	bool isSuitable() const {
+		return hasRequiredExtensions && queueFamilyIndices.isComplete() && !swapChainSupport.formats.empty() &&
+			   !swapChainSupport.presentModes.empty();
+	}
+
+	// Only rates what the engine uses, 0 if the device cannot run it at all
+	int getScore() const {
+		if (!isSuitable()) return 0;
+
+		int score = 1;
+		switch (properties.deviceType) {
+		case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+			score += 1000;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+			score += 500;
+			break;
+		case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+			score += 250;
+			break;
+		default:
+			break;
+		}
+
+		// 1 point per 16 MiB of the largest device local heap
+		score += static_cast<int>(std::min<VkDeviceSize>(deviceLocalMemory >> 24, 1000));
+
+		// Presenting from the graphics queue needs no concurrent sharing of the swapchain images
+		if (queueFamilyIndices.graphicsFamily == queueFamilyIndices.presentFamily) score += 100;
+		if (queueFamilyIndices.transferFamily) score += 50;
+		if (supportsTimestamps) score += 50;
+
+		return score;
+	}
+};
+
+inline DeviceCapabilities queryDeviceCapabilities(const VkPhysicalDevice device, const VkSurfaceKHR surface,
+												  const list<const char *> &requiredExtensions) {
+	DeviceCapabilities capabilities;
+	capabilities.physicalDevice = device;
+	vkGetPhysicalDeviceProperties(device, &capabilities.properties);
+	vkGetPhysicalDeviceFeatures(device, &capabilities.features);
+	vkGetPhysicalDeviceMemoryProperties(device, &capabilities.memoryProperties);
+
+	enumerate(capabilities.queueFamilies, vkGetPhysicalDeviceQueueFamilyProperties, device);
+	enumerate(capabilities.extensions, vkEnumerateDeviceExtensionProperties, device,
+			  static_cast<const char *>(nullptr));
+
+	capabilities.hasRequiredExtensions =
+		std::all_of(requiredExtensions.begin(), requiredExtensions.end(),
+					[&](const char *name) { return capabilities.hasExtension(name); });
+
+	QueueFamilyIndices &indices = capabilities.queueFamilyIndices;
+	for (uint32_t i = 0; i < capabilities.queueFamilies.size(); ++i) {
+		const VkQueueFlags flags = capabilities.queueFamilies[i].queueFlags;
+
+		VkBool32 presentSupport = false;
+		vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
+
+		// A family doing both is preferred over separate ones
+		const bool isGraphics = flags & VK_QUEUE_GRAPHICS_BIT;
+		const bool hasSharedFamily = indices.graphicsFamily && indices.graphicsFamily == indices.presentFamily;
+		if (isGraphics && presentSupport && !hasSharedFamily) indices.graphicsFamily = indices.presentFamily = i;
+		if (isGraphics && !indices.graphicsFamily) indices.graphicsFamily = i;
+		if (presentSupport && !indices.presentFamily) indices.presentFamily = i;
+
+		if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)) &&
+			!indices.transferFamily) {
+			indices.transferFamily = i;
+		}
+	}
+
+	if (capabilities.hasRequiredExtensions) capabilities.swapChainSupport = querySwapChainSupport(device, surface);
+
+	for (uint32_t i = 0; i < capabilities.memoryProperties.memoryHeapCount; ++i) {
+		const VkMemoryHeap &heap = capabilities.memoryProperties.memoryHeaps[i];
+		if (heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) {
+			capabilities.deviceLocalMemory = std::max(capabilities.deviceLocalMemory, heap.size);
+		}
+	}
+
+	capabilities.supportsTimestamps = indices.graphicsFamily &&
+									  capabilities.properties.limits.timestampPeriod > 0.0f &&
+									  capabilities.queueFamilies[*indices.graphicsFamily].timestampValidBits > 0;
+
+	return capabilities;
+}
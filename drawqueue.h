@@ -0,0 +1,83 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+// Pipeline ids take 8 bits of the sort key
+constexpr uint32_t MAX_PIPELINE_IDS = 1 << 8;
+
+struct DrawCommand {
+	uint8_t layer;
+	// Distinct for every pipeline drawn in a frame, the index of its variant
+	uint8_t pipelineId;
+	uint16_t texture;
+	float depth;
+
+	VkPipeline pipeline;
+	VkDescriptorSet descriptorSet;
+
+	uint32_t indexCount, firstIndex;
+	int32_t vertexOffset;
+
+	// layer:8 | pipeline:8 | texture:16 | depth:32, so sorting groups draws sharing the same state
+	uint64_t sortKey() const {
+		// Flipping the sign bit (or every bit for negatives) makes the float bits order like the float values
+		const uint32_t depthBits = std::bit_cast<uint32_t>(depth);
+		const uint32_t orderedDepth = depthBits & 0x80000000u ? ~depthBits : depthBits | 0x80000000u;
+
+		return static_cast<uint64_t>(layer) << 56 | static_cast<uint64_t>(pipelineId) << 48 |
+			   static_cast<uint64_t>(texture) << 32 | orderedDepth;
+	}
+};
+
+class DrawQueue {
+  public:
+	uint32_t pipelineBinds = 0, descriptorSetBinds = 0;
+
+	void push(const DrawCommand &command) { commands.push_back(command); }
+
+	// Drops the commands without touching their storage, which may be in a frame arena reset since
+	void reset(std::pmr::memory_resource *resource, const size_t capacity) {
+		commands = pmr_list<DrawCommand>(resource);
+		commands.reserve(capacity);
+	}
+
+	size_t size() const { return commands.size(); }
+
+	void sort() {
+		std::sort(commands.begin(), commands.end(),
+				  [](const DrawCommand &a, const DrawCommand &b) { return a.sortKey() < b.sortKey(); });
+	}
+
+	// Expects the vertex and index buffers to be bound, only rebinds state that changes between draws
+	void record(const VkCommandBuffer commandBuffer, const VkPipelineLayout pipelineLayout) {
+		VkPipeline boundPipeline = VK_NULL_HANDLE;
+		VkDescriptorSet boundDescriptorSet = VK_NULL_HANDLE;
+		pipelineBinds = descriptorSetBinds = 0;
+
+		for (const DrawCommand &command : commands) {
+			if (command.pipeline != boundPipeline) {
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, command.pipeline);
+				boundPipeline = command.pipeline;
+				++pipelineBinds;
+			}
+
+			if (command.descriptorSet != boundDescriptorSet) {
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
+										&command.descriptorSet, 0, VK_NULL_HANDLE);
+				boundDescriptorSet = command.descriptorSet;
+				++descriptorSetBinds;
+			}
+
+			vkCmdDrawIndexed(commandBuffer, command.indexCount, 1, command.firstIndex, command.vertexOffset, 0);
+		}
+	}
+
+  private:
+	pmr_list<DrawCommand> commands;
+};
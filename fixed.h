@@ -0,0 +1,135 @@
+#pragma once
+
+#include <array>
+#include <compare>
+#include <cstdint>
+
+// Q16.16 fixed point for the simulation. Integer arithmetic gives the same bits on every compiler and CPU, which
+// floats do not once FMA contraction or x87 precision get involved, and replays and netplay depend on that. Floats
+// only come out of it for rendering
+struct Fixed {
+	static constexpr int FRACTION_BITS = 16;
+	static constexpr int32_t ONE = 1 << FRACTION_BITS;
+
+	int32_t raw = 0;
+
+	static constexpr Fixed fromRaw(const int32_t raw) { return Fixed{raw}; }
+	static constexpr Fixed fromInt(const int32_t value) { return Fixed{value * ONE}; }
+	// numerator / denominator, rounded towards zero
+	static constexpr Fixed fromRatio(const int32_t numerator, const int32_t denominator) {
+		return Fixed{static_cast<int32_t>(static_cast<int64_t>(numerator) * ONE / denominator)};
+	}
+
+	constexpr int32_t toInt() const { return raw >> FRACTION_BITS; }
+	constexpr float toFloat() const { return static_cast<float>(raw) / ONE; }
+
+	constexpr Fixed operator-() const { return Fixed{-raw}; }
+	constexpr Fixed operator+(const Fixed other) const { return Fixed{raw + other.raw}; }
+	constexpr Fixed operator-(const Fixed other) const { return Fixed{raw - other.raw}; }
+	// Rounds towards negative infinity, like the shift
+	constexpr Fixed operator*(const Fixed other) const {
+		return Fixed{static_cast<int32_t>(static_cast<int64_t>(raw) * other.raw >> FRACTION_BITS)};
+	}
+	constexpr Fixed operator/(const Fixed other) const {
+		return Fixed{static_cast<int32_t>((static_cast<int64_t>(raw) << FRACTION_BITS) / other.raw)};
+	}
+
+	constexpr Fixed &operator+=(const Fixed other) { return *this = *this + other; }
+	constexpr Fixed &operator-=(const Fixed other) { return *this = *this - other; }
+	constexpr Fixed &operator*=(const Fixed other) { return *this = *this * other; }
+
+	constexpr auto operator<=>(const Fixed &) const = default;
+};
+
+static_assert(sizeof(Fixed) == sizeof(int32_t));
+
+struct FixedVec2 {
+	Fixed x, y;
+
+	constexpr FixedVec2 operator+(const FixedVec2 other) const { return {x + other.x, y + other.y}; }
+	constexpr FixedVec2 operator-(const FixedVec2 other) const { return {x - other.x, y - other.y}; }
+	constexpr FixedVec2 operator*(const Fixed scale) const { return {x * scale, y * scale}; }
+	constexpr FixedVec2 &operator+=(const FixedVec2 other) { return *this = *this + other; }
+
+	constexpr Fixed dot(const FixedVec2 other) const { return x * other.x + y * other.y; }
+
+	constexpr bool operator==(const FixedVec2 &) const = default;
+};
+
+// Binary angle, a full turn is 65536 and wraps around like the integer
+using Angle = uint16_t;
+
+constexpr Angle ANGLE_QUARTER_TURN = 1 << 14;
+
+// Sine of a full turn in 4096 steps, computed with integers at compile time so the table is the same everywhere
+constexpr uint32_t SINE_TABLE_BITS = 12;
+constexpr uint32_t SINE_TABLE_SIZE = 1 << SINE_TABLE_BITS;
+
+inline constexpr std::array<Fixed, SINE_TABLE_SIZE> SINE_TABLE = [] {
+	// Taylor series in Q2.30 over the first quarter, mirrored for the rest of the turn
+	constexpr int64_t HALF_PI_Q30 = 1686629713;
+	constexpr uint32_t QUARTER = SINE_TABLE_SIZE / 4;
+
+	std::array<Fixed, SINE_TABLE_SIZE> table{};
+	for (uint32_t i = 0; i <= QUARTER; ++i) {
+		const int64_t x = HALF_PI_Q30 * i / QUARTER;
+		const int64_t x2 = x * x >> 30;
+
+		int64_t term = x, sum = x;
+		for (int64_t k = 1; k < 12; ++k) {
+			term = -(term * x2 >> 30) / ((2 * k) * (2 * k + 1));
+			sum += term;
+		}
+		const int32_t value = static_cast<int32_t>((sum + (1 << 13)) >> 14);
+
+		table[i] = Fixed::fromRaw(value);
+		table[(SINE_TABLE_SIZE / 2 - i) % SINE_TABLE_SIZE] = Fixed::fromRaw(value);
+		table[(SINE_TABLE_SIZE / 2 + i) % SINE_TABLE_SIZE] = Fixed::fromRaw(-value);
+		table[(SINE_TABLE_SIZE - i) % SINE_TABLE_SIZE] = Fixed::fromRaw(-value);
+	}
+	return table;
+}();
+
+constexpr Fixed fixedSin(const Angle angle) { return SINE_TABLE[angle >> (16 - SINE_TABLE_BITS)]; }
+constexpr Fixed fixedCos(const Angle angle) { return fixedSin(static_cast<Angle>(angle + ANGLE_QUARTER_TURN)); }
+
+// Unit vector scaled by length, pointing at angle counterclockwise from +x
+constexpr FixedVec2 fromAngle(const Angle angle, const Fixed length) {
+	return {fixedCos(angle) * length, fixedSin(angle) * length};
+}
+
+// Angle of atan(i / ATAN_TABLE_SIZE), for ratios in [0, 1]. Searched in the sine table, so fixedSin and fixedCos of
+// the result point back the same way
+constexpr uint32_t ATAN_TABLE_SIZE = 256;
+
+inline constexpr std::array<Angle, ATAN_TABLE_SIZE + 1> ATAN_TABLE = [] {
+	constexpr uint32_t STEP = 1 << (16 - SINE_TABLE_BITS);
+
+	std::array<Angle, ATAN_TABLE_SIZE + 1> table{};
+	for (uint32_t i = 0, step = 0; i <= ATAN_TABLE_SIZE; ++i) {
+		// Smallest step with sin >= ratio * cos, at most an eighth of a turn
+		while (static_cast<int64_t>(SINE_TABLE[step].raw) * ATAN_TABLE_SIZE <
+			   static_cast<int64_t>(SINE_TABLE[step + SINE_TABLE_SIZE / 4].raw) * i) {
+			++step;
+		}
+		table[i] = static_cast<Angle>(step * STEP);
+	}
+	return table;
+}();
+
+// Angle of the vector (x, y), 0 for the null vector
+constexpr Angle fixedAtan2(const Fixed y, const Fixed x) {
+	if (x.raw == 0 && y.raw == 0) return 0;
+
+	const int64_t ax = x.raw < 0 ? -static_cast<int64_t>(x.raw) : x.raw;
+	const int64_t ay = y.raw < 0 ? -static_cast<int64_t>(y.raw) : y.raw;
+
+	// Folded into the first octant, then unfolded
+	const bool steep = ay > ax;
+	const int64_t ratio = steep ? ax * ATAN_TABLE_SIZE / ay : ay * ATAN_TABLE_SIZE / ax;
+	Angle angle = ATAN_TABLE[ratio];
+	if (steep) angle = static_cast<Angle>(ANGLE_QUARTER_TURN - angle);
+	if (x.raw < 0) angle = static_cast<Angle>(2 * ANGLE_QUARTER_TURN - angle);
+	if (y.raw < 0) angle = static_cast<Angle>(-angle);
+	return angle;
+}
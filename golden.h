@@ -0,0 +1,43 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+
+#include "bench.h"
+#include "utils.h"
+
+// Golden image tests render a fixed number of frames per scene with the animation driven by the frame index, and
+// compare some of them against PNGs rendered before on the same software rasterizer
+constexpr uint32_t GOLDEN_FRAMES = 60;
+constexpr uint32_t GOLDEN_CAPTURE_INTERVAL = 15;
+constexpr float GOLDEN_FRAME_TIME = 1.0f / 60.0f;
+
+// Largest difference allowed on any channel of any pixel, rasterizer updates may move a few edges by a step
+constexpr uint8_t GOLDEN_TOLERANCE = 2;
+
+// Rendered after the default scene, like the benchmark scenes
+constexpr BenchScene GOLDEN_SCENES[] = {
+	{"variants", 2'000, 8, 16, 0},
+};
+
+struct ImageDifference {
+	uint8_t maxDifference = 0;
+	size_t pixelsOverTolerance = 0;
+};
+
+// Both tightly packed RGBA8 of the same size
+inline ImageDifference compareImages(const uint8_t *a, const uint8_t *b, const size_t pixelCount,
+									 const uint8_t tolerance) {
+	ImageDifference difference;
+	for (size_t i = 0; i < pixelCount; ++i) {
+		uint8_t pixelDifference = 0;
+		for (size_t c = 0; c < 4; ++c) {
+			pixelDifference = std::max(pixelDifference, static_cast<uint8_t>(std::abs(a[i * 4 + c] - b[i * 4 + c])));
+		}
+		difference.maxDifference = std::max(difference.maxDifference, pixelDifference);
+		if (pixelDifference > tolerance) ++difference.pixelsOverTolerance;
+	}
+	return difference;
+}
@@ -0,0 +1,163 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
+
+#include "jobs.h"
+#include "utils.h"
+
+inline double millisecondsSince(const std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+// Initialization steps and the steps they depend on. Steps touching the window, the command pool or the queue run
+// on the calling thread, the others may be handed to the job system as soon as their dependencies are done
+class InitGraph {
+  public:
+	using StepId = size_t;
+
+	enum class Thread {
+		Main,
+		Worker,
+	};
+
+	// Dependencies have to be added first, which keeps the graph acyclic
+	StepId add(const std::string &name, const list<StepId> &dependencies, std::function<void()> &&function,
+			   const Thread thread = Thread::Main) {
+		const StepId id = steps.size();
+		steps.push_back(Step{
+			.name = name,
+			.function = std::move(function),
+			.thread = thread,
+			.dependents = {},
+			.pendingDependencies = dependencies.size(),
+			.start = 0.0,
+			.duration = 0.0,
+		});
+		for (const StepId dependency : dependencies) {
+			steps[dependency].dependents.push_back(id);
+		}
+		return id;
+	}
+
+	void run(JobSystem &jobs) {
+		const auto start = std::chrono::steady_clock::now();
+		for (StepId id = 0; id < steps.size(); ++id) {
+			if (steps[id].pendingDependencies == 0) schedule(jobs, id, start);
+		}
+
+		size_t finished = 0;
+		while (finished < steps.size()) {
+			if (!readyOnMain.empty()) {
+				const StepId id = readyOnMain.front();
+				readyOnMain.pop_front();
+				try {
+					execute(id, start);
+				} catch (...) {
+					waitForWorkers();
+					throw;
+				}
+				++finished;
+				complete(jobs, id, start);
+				continue;
+			}
+
+			std::unique_lock lock(mutex);
+			stepFinished.wait(lock, [this] { return !finishedOnWorkers.empty(); });
+			std::deque<StepId> done = std::move(finishedOnWorkers);
+			finishedOnWorkers.clear();
+			inFlight -= done.size();
+			// Workers still running may set it, so it is only read under the lock
+			const std::exception_ptr stepError = error;
+			lock.unlock();
+
+			if (stepError) {
+				waitForWorkers();
+				std::rethrow_exception(stepError);
+			}
+			for (const StepId id : done) {
+				++finished;
+				complete(jobs, id, start);
+			}
+		}
+
+		totalDuration = millisecondsSince(start);
+	}
+
+	void logTimings() const {
+		double serialDuration = 0.0;
+		for (const Step &step : steps) {
+			LOG("  " << step.name << (step.thread == Thread::Worker ? " [worker]" : "") << ": started at "
+					 << step.start << " ms, took " << step.duration << " ms");
+			serialDuration += step.duration;
+		}
+		LOG("Initialization took " << totalDuration << " ms, " << serialDuration << " ms when run in order");
+	}
+
+  private:
+	struct Step {
+		std::string name;
+		std::function<void()> function;
+		Thread thread;
+		list<StepId> dependents;
+		size_t pendingDependencies;
+		// Milliseconds since the graph started running
+		double start, duration;
+	};
+
+	list<Step> steps;
+	std::deque<StepId> readyOnMain;
+	double totalDuration = 0.0;
+
+	std::mutex mutex;
+	std::condition_variable stepFinished;
+	std::deque<StepId> finishedOnWorkers;
+	size_t inFlight = 0;
+	std::exception_ptr error;
+
+	void execute(const StepId id, const std::chrono::steady_clock::time_point start) {
+		Step &step = steps[id];
+		step.start = millisecondsSince(start);
+		step.function();
+		step.duration = millisecondsSince(start) - step.start;
+	}
+
+	void schedule(JobSystem &jobs, const StepId id, const std::chrono::steady_clock::time_point start) {
+		if (steps[id].thread == Thread::Main || jobs.threadCount() == 0) {
+			readyOnMain.push_back(id);
+			return;
+		}
+
+		++inFlight;
+		jobs.submit([this, id, start] {
+			std::exception_ptr stepError;
+			try {
+				execute(id, start);
+			} catch (...) {
+				stepError = std::current_exception();
+			}
+
+			std::lock_guard lock(mutex);
+			if (stepError && !error) error = stepError;
+			finishedOnWorkers.push_back(id);
+			stepFinished.notify_one();
+		});
+	}
+
+	void complete(JobSystem &jobs, const StepId id, const std::chrono::steady_clock::time_point start) {
+		for (const StepId dependent : steps[id].dependents) {
+			if (--steps[dependent].pendingDependencies == 0) schedule(jobs, dependent, start);
+		}
+	}
+
+	void waitForWorkers() {
+		std::unique_lock lock(mutex);
+		stepFinished.wait(lock, [this] { return finishedOnWorkers.size() == inFlight; });
+	}
+};
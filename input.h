@@ -0,0 +1,151 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+
+#include "utils.h"
+
+// Simulation steps per second. Input is sampled once per tick, so a recording replays identically whatever the frame
+// rate of the machine playing it
+constexpr uint32_t TICK_RATE = 60;
+constexpr double TICK_TIME = 1.0 / TICK_RATE;
+// Ticks run by a single frame at most, a slow frame slows the simulation down rather than stalling on catching up
+constexpr uint32_t MAX_TICKS_PER_FRAME = 4;
+
+enum class Button : uint32_t {
+	Up,
+	Down,
+	Left,
+	Right,
+	Shoot,
+	Bomb,
+	Focus,
+	Quit,
+	ReloadTexture,
+	MemoryStats,
+};
+
+constexpr uint16_t getButtonMask(const Button button) {
+	return static_cast<uint16_t>(1u << static_cast<uint32_t>(button));
+}
+
+// Buttons held during one tick
+struct InputState {
+	uint16_t buttons = 0;
+
+	bool isHeld(const Button button) const { return (buttons & getButtonMask(button)) != 0; }
+	// Held now but not during the previous tick
+	bool isPressed(const Button button, const InputState previous) const {
+		return isHeld(button) && !previous.isHeld(button);
+	}
+
+	bool operator==(const InputState &) const = default;
+};
+
+// Recordings are an 8 byte header followed by the runs of identical ticks. Every run is the 16 bit little endian
+// buttons and its tick count as a LEB128 varint, so an idle stretch takes 3 bytes however long it lasts
+constexpr char INPUT_MAGIC[4] = {'T', 'H', 'I', 'R'};
+constexpr uint16_t INPUT_VERSION = 1;
+
+class InputRecorder {
+  public:
+	~InputRecorder() { stop(); }
+
+	bool start(const std::string &path) {
+		file.open(path, std::ios::binary);
+		if (!file.is_open()) return false;
+
+		file.write(INPUT_MAGIC, sizeof(INPUT_MAGIC));
+		writeLittleEndian(INPUT_VERSION);
+		writeLittleEndian(static_cast<uint16_t>(TICK_RATE));
+		runLength = 0;
+		tickCount = 0;
+		return true;
+	}
+
+	// Flushes the last run
+	void stop() {
+		if (!file.is_open()) return;
+
+		writeRun();
+		file.close();
+	}
+
+	void record(const InputState state) {
+		if (runLength != 0 && state != runState) writeRun();
+		runState = state;
+		++runLength;
+		++tickCount;
+	}
+
+	uint64_t getTickCount() const { return tickCount; }
+
+  private:
+	std::ofstream file;
+	InputState runState;
+	uint64_t runLength = 0, tickCount = 0;
+
+	void writeLittleEndian(const uint16_t value) {
+		file.put(static_cast<char>(value & 0xFF));
+		file.put(static_cast<char>(value >> 8));
+	}
+
+	void writeRun() {
+		if (runLength == 0) return;
+
+		writeLittleEndian(runState.buttons);
+		for (uint64_t value = runLength; true; value >>= 7) {
+			if (value < 0x80) {
+				file.put(static_cast<char>(value));
+				break;
+			}
+			file.put(static_cast<char>((value & 0x7F) | 0x80));
+		}
+		runLength = 0;
+	}
+};
+
+class InputReplay {
+  public:
+	// False when the file can not be read or is not a recording of this version and tick rate
+	bool load(const std::string &path) {
+		std::ifstream file(path, std::ios::binary);
+		if (!file.is_open()) return false;
+
+		data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+		offset = 8;
+		runLength = 0;
+		return data.size() >= offset && memcmp(data.data(), INPUT_MAGIC, sizeof(INPUT_MAGIC)) == 0 &&
+			   readLittleEndian(4) == INPUT_VERSION && readLittleEndian(6) == TICK_RATE;
+	}
+
+	// Empty once the recording is over
+	std::optional<InputState> next() {
+		while (runLength == 0) {
+			if (offset + 2 > data.size()) return std::nullopt;
+
+			runState.buttons = readLittleEndian(offset);
+			offset += 2;
+			for (uint32_t shift = 0; offset < data.size() && shift < 64; shift += 7) {
+				const uint8_t byte = data[offset++];
+				runLength |= static_cast<uint64_t>(byte & 0x7F) << shift;
+				if ((byte & 0x80) == 0) break;
+			}
+		}
+
+		--runLength;
+		return runState;
+	}
+
+  private:
+	list<uint8_t> data;
+	size_t offset = 0;
+	InputState runState;
+	uint64_t runLength = 0;
+
+	uint16_t readLittleEndian(const size_t at) const { return static_cast<uint16_t>(data[at] | data[at + 1] << 8); }
+};
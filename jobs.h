@@ -0,0 +1,72 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "utils.h"
+
+// Fixed pool of worker threads running jobs in submission order. Jobs still queued when stopping are dropped
+class JobSystem {
+  public:
+	~JobSystem() { stop(); }
+
+	void start(size_t threadCount = 0) {
+		if (threadCount == 0) threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+
+		LOG("Starting " << threadCount << " worker threads");
+		stopping = false;
+		for (size_t i = 0; i < threadCount; ++i) {
+			workers.emplace_back([this] { work(); });
+		}
+	}
+
+	void stop() {
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+			jobs.clear();
+		}
+		jobAvailable.notify_all();
+
+		for (std::thread &worker : workers) {
+			worker.join();
+		}
+		workers.clear();
+	}
+
+	void submit(std::function<void()> &&job) {
+		{
+			std::lock_guard lock(mutex);
+			jobs.push_back(std::move(job));
+		}
+		jobAvailable.notify_one();
+	}
+
+	size_t threadCount() const { return workers.size(); }
+
+  private:
+	list<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable jobAvailable;
+	bool stopping = false;
+
+	void work() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock lock(mutex);
+				jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (stopping) return;
+
+				job = std::move(jobs.front());
+				jobs.pop_front();
+			}
+			job();
+		}
+	}
+};
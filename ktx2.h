@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+// https://registry.khronos.org/KTX/specs/2.0/ktxspec.v2.html
+constexpr uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+// Past any device's maxImageDimension2D, and small enough that level sizes cannot overflow
+constexpr uint32_t KTX2_MAX_EXTENT = 1 << 16;
+
+enum Ktx2Supercompression : uint32_t {
+	KTX2_SUPERCOMPRESSION_NONE = 0,
+	KTX2_SUPERCOMPRESSION_BASIS_LZ = 1,
+	KTX2_SUPERCOMPRESSION_ZSTD = 2,
+	KTX2_SUPERCOMPRESSION_ZLIB = 3,
+};
+
+struct Ktx2Header {
+	uint8_t identifier[12];
+	uint32_t vkFormat;
+	uint32_t typeSize;
+	uint32_t pixelWidth, pixelHeight, pixelDepth;
+	uint32_t layerCount, faceCount, levelCount;
+	uint32_t supercompressionScheme;
+
+	uint32_t dfdByteOffset, dfdByteLength;
+	uint32_t kvdByteOffset, kvdByteLength;
+	uint64_t sgdByteOffset, sgdByteLength;
+};
+
+struct Ktx2Level {
+	uint64_t byteOffset, byteLength, uncompressedByteLength;
+};
+
+static_assert(sizeof(Ktx2Header) == 80);
+static_assert(sizeof(Ktx2Level) == 24);
+
+// View over a KTX2 file in memory, levels are indexed from the base level and point inside the file
+struct Ktx2Texture {
+	VkFormat format;
+	uint32_t width, height;
+	list<Ktx2Level> levels;
+	const uint8_t *data;
+	size_t size;
+};
+
+// Texel block of a format and its size in bytes, a single texel for uncompressed formats. The size is 0 for formats
+// missing here, the level sizes of their files cannot be checked
+struct FormatBlock {
+	uint32_t width, height, size;
+};
+
+constexpr FormatBlock ASTC_BLOCKS[] = {
+	{4, 4, 16}, {5, 4, 16}, {5, 5, 16}, {6, 5, 16}, {6, 6, 16}, {8, 5, 16}, {8, 6, 16},
+	{8, 8, 16}, {10, 5, 16}, {10, 6, 16}, {10, 8, 16}, {10, 10, 16}, {12, 10, 16}, {12, 12, 16},
+};
+
+inline FormatBlock getFormatBlock(const VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_R8_UNORM:
+	case VK_FORMAT_R8_SRGB:
+		return {1, 1, 1};
+	case VK_FORMAT_R8G8_UNORM:
+	case VK_FORMAT_R8G8_SRGB:
+	case VK_FORMAT_R16_SFLOAT:
+		return {1, 1, 2};
+	case VK_FORMAT_R8G8B8A8_UNORM:
+	case VK_FORMAT_R8G8B8A8_SRGB:
+	case VK_FORMAT_B8G8R8A8_UNORM:
+	case VK_FORMAT_B8G8R8A8_SRGB:
+	case VK_FORMAT_A2B10G10R10_UNORM_PACK32:
+	case VK_FORMAT_B10G11R11_UFLOAT_PACK32:
+	case VK_FORMAT_R16G16_SFLOAT:
+	case VK_FORMAT_R32_SFLOAT:
+		return {1, 1, 4};
+	case VK_FORMAT_R16G16B16A16_SFLOAT:
+	case VK_FORMAT_R32G32_SFLOAT:
+		return {1, 1, 8};
+	case VK_FORMAT_R32G32B32A32_SFLOAT:
+		return {1, 1, 16};
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A1_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11_SNORM_BLOCK:
+		return {4, 4, 8};
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+	case VK_FORMAT_BC5_UNORM_BLOCK:
+	case VK_FORMAT_BC5_SNORM_BLOCK:
+	case VK_FORMAT_BC6H_UFLOAT_BLOCK:
+	case VK_FORMAT_BC6H_SFLOAT_BLOCK:
+	case VK_FORMAT_BC7_UNORM_BLOCK:
+	case VK_FORMAT_BC7_SRGB_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_UNORM_BLOCK:
+	case VK_FORMAT_ETC2_R8G8B8A8_SRGB_BLOCK:
+	case VK_FORMAT_EAC_R11G11_UNORM_BLOCK:
+	case VK_FORMAT_EAC_R11G11_SNORM_BLOCK:
+		return {4, 4, 16};
+	default:
+		// ASTC formats come in UNORM and SRGB pairs, one pair per block footprint
+		if (format >= VK_FORMAT_ASTC_4x4_UNORM_BLOCK && format <= VK_FORMAT_ASTC_12x12_SRGB_BLOCK) {
+			return ASTC_BLOCKS[(format - VK_FORMAT_ASTC_4x4_UNORM_BLOCK) / 2];
+		}
+		return {0, 0, 0};
+	}
+}
+
+// Bytes of a level with the given extent, at most 2^36 below KTX2_MAX_EXTENT
+inline uint64_t getLevelByteLength(const FormatBlock &block, const uint32_t width, const uint32_t height) {
+	const uint64_t blocksWide = (width + block.width - 1) / block.width;
+	const uint64_t blocksHigh = (height + block.height - 1) / block.height;
+	return blocksWide * blocksHigh * block.size;
+}
+
+// Unlike VALIDATE, these checks stay in release builds: a malformed file would otherwise be read out of bounds
+inline void requireKtx2(const bool condition, const std::string &message) {
+	if (!condition) throw std::runtime_error(message);
+}
+
+inline Ktx2Texture parseKtx2(const uint8_t *data, const size_t size) {
+	requireKtx2(size >= sizeof(Ktx2Header), "KTX2 file is too small!");
+
+	Ktx2Header header;
+	memcpy(&header, data, sizeof(header));
+
+	requireKtx2(memcmp(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0, "Not a KTX2 file!");
+	requireKtx2(header.pixelDepth <= 1 && header.layerCount <= 1 && header.faceCount == 1,
+				"Only 2D KTX2 textures are supported!");
+	requireKtx2(header.vkFormat != VK_FORMAT_UNDEFINED,
+				"Basis Universal KTX2 textures need transcoding, which is not available!");
+	requireKtx2(header.supercompressionScheme == KTX2_SUPERCOMPRESSION_NONE,
+				"Supercompressed KTX2 textures are not supported: " + std::to_string(header.supercompressionScheme));
+
+	const FormatBlock block = getFormatBlock(static_cast<VkFormat>(header.vkFormat));
+	requireKtx2(block.size != 0, "Unsupported KTX2 texture format: " + std::to_string(header.vkFormat));
+
+	// A height of 0 makes a 1D texture, one texel high
+	const uint32_t width = header.pixelWidth, height = std::max(header.pixelHeight, 1u);
+	requireKtx2(width > 0 && width <= KTX2_MAX_EXTENT && height <= KTX2_MAX_EXTENT,
+				"Invalid KTX2 texture extent: " + std::to_string(width) + "x" + std::to_string(height));
+
+	// A level count of 0 asks for the mip chain to be generated, the file only holds the base level then
+	const uint32_t levelCount = std::max(header.levelCount, 1u);
+	requireKtx2(levelCount <= static_cast<uint32_t>(std::bit_width(std::max(width, height))),
+				"Too many KTX2 levels for the texture extent: " + std::to_string(levelCount));
+	requireKtx2(size >= sizeof(Ktx2Header) + levelCount * sizeof(Ktx2Level), "Truncated KTX2 level index!");
+
+	Ktx2Texture texture{
+		.format = static_cast<VkFormat>(header.vkFormat),
+		.width = width,
+		.height = height,
+		.levels = list<Ktx2Level>(levelCount),
+		.data = data,
+		.size = size,
+	};
+	memcpy(texture.levels.data(), data + sizeof(Ktx2Header), levelCount * sizeof(Ktx2Level));
+
+	for (uint32_t i = 0; i < levelCount; ++i) {
+		const Ktx2Level &level = texture.levels[i];
+		requireKtx2(level.byteOffset <= size && level.byteLength <= size - level.byteOffset,
+					"KTX2 level " + std::to_string(i) + " out of bounds!");
+		requireKtx2(level.byteLength >= getLevelByteLength(block, std::max(width >> i, 1u), std::max(height >> i, 1u)),
+					"KTX2 level " + std::to_string(i) + " is too short for its extent!");
+	}
+	return texture;
+}
+
+// CPU fallback for devices without BCn sampling support
+
+inline bool isCpuDecodable(const VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC2_UNORM_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_UNORM_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+		return true;
+	default:
+		return false;
+	}
+}
+
+inline VkFormat getCpuDecodedFormat(const VkFormat format) {
+	switch (format) {
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC2_SRGB_BLOCK:
+	case VK_FORMAT_BC3_SRGB_BLOCK:
+		return VK_FORMAT_R8G8B8A8_SRGB;
+	default:
+		return VK_FORMAT_R8G8B8A8_UNORM;
+	}
+}
+
+// Writes the 4x4 RGBA8 texels of a BC1 color block. Blocks with c0 <= c1 use 3 colors and black, unless they are the
+// color half of BC2 or BC3, and the black is only transparent in BC1 RGBA
+inline void decodeBc1Colors(const uint8_t *block, uint8_t texels[16][4], const bool alwaysFourColors,
+							const bool allowTransparent) {
+	const uint16_t c0 = block[0] | block[1] << 8, c1 = block[2] | block[3] << 8;
+	const uint32_t indices = block[4] | block[5] << 8 | block[6] << 16 | static_cast<uint32_t>(block[7]) << 24;
+
+	uint8_t palette[4][4];
+	const auto expand = [](const uint16_t c, uint8_t *out) {
+		out[0] = static_cast<uint8_t>((c >> 11 & 0x1F) * 255 / 31);
+		out[1] = static_cast<uint8_t>((c >> 5 & 0x3F) * 255 / 63);
+		out[2] = static_cast<uint8_t>((c & 0x1F) * 255 / 31);
+		out[3] = 255;
+	};
+	expand(c0, palette[0]);
+	expand(c1, palette[1]);
+
+	const bool fourColors = c0 > c1 || alwaysFourColors;
+	for (int i = 0; i < 3; ++i) {
+		if (fourColors) {
+			palette[2][i] = static_cast<uint8_t>((2 * palette[0][i] + palette[1][i]) / 3);
+			palette[3][i] = static_cast<uint8_t>((palette[0][i] + 2 * palette[1][i]) / 3);
+		} else {
+			palette[2][i] = static_cast<uint8_t>((palette[0][i] + palette[1][i]) / 2);
+			palette[3][i] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = fourColors || !allowTransparent ? 255 : 0;
+
+	for (int i = 0; i < 16; ++i) {
+		memcpy(texels[i], palette[indices >> (2 * i) & 0x3], 4);
+	}
+}
+
+inline void decodeBc3Alpha(const uint8_t *block, uint8_t texels[16][4]) {
+	const uint8_t a0 = block[0], a1 = block[1];
+	uint64_t indices = 0;
+	for (int i = 0; i < 6; ++i) {
+		indices |= static_cast<uint64_t>(block[2 + i]) << (8 * i);
+	}
+
+	uint8_t palette[8] = {a0, a1};
+	if (a0 > a1) {
+		for (int i = 1; i < 7; ++i) {
+			palette[i + 1] = static_cast<uint8_t>(((7 - i) * a0 + i * a1) / 7);
+		}
+	} else {
+		for (int i = 1; i < 5; ++i) {
+			palette[i + 1] = static_cast<uint8_t>(((5 - i) * a0 + i * a1) / 5);
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	for (int i = 0; i < 16; ++i) {
+		texels[i][3] = palette[indices >> (3 * i) & 0x7];
+	}
+}
+
+// Decodes one level into tightly packed RGBA8
+inline list<uint8_t> decodeBlockCompressed(const VkFormat format, const uint8_t *src, const uint32_t width,
+										   const uint32_t height) {
+	VALIDATE(isCpuDecodable(format), "No CPU decoder for texture format " + std::to_string(format));
+
+	const bool hasAlphaBlock = format != VK_FORMAT_BC1_RGB_UNORM_BLOCK && format != VK_FORMAT_BC1_RGB_SRGB_BLOCK &&
+							   format != VK_FORMAT_BC1_RGBA_UNORM_BLOCK && format != VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	const bool isBc2 = format == VK_FORMAT_BC2_UNORM_BLOCK || format == VK_FORMAT_BC2_SRGB_BLOCK;
+	const bool allowTransparent = format == VK_FORMAT_BC1_RGBA_UNORM_BLOCK || format == VK_FORMAT_BC1_RGBA_SRGB_BLOCK;
+	const size_t blockSize = hasAlphaBlock ? 16 : 8;
+
+	list<uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+	uint8_t texels[16][4];
+
+	for (uint32_t by = 0; by < (height + 3) / 4; ++by) {
+		for (uint32_t bx = 0; bx < (width + 3) / 4; ++bx, src += blockSize) {
+			// BC2 and BC3 color blocks always use the four color mode
+			decodeBc1Colors(hasAlphaBlock ? src + 8 : src, texels, hasAlphaBlock, allowTransparent);
+
+			if (isBc2) {
+				for (int i = 0; i < 16; ++i) {
+					texels[i][3] = static_cast<uint8_t>((src[i / 2] >> (4 * (i % 2)) & 0xF) * 17);
+				}
+			} else if (hasAlphaBlock) {
+				decodeBc3Alpha(src, texels);
+			}
+
+			for (uint32_t y = 0; y < 4 && by * 4 + y < height; ++y) {
+				for (uint32_t x = 0; x < 4 && bx * 4 + x < width; ++x) {
+					memcpy(&pixels[((by * 4 + y) * width + bx * 4 + x) * 4], texels[y * 4 + x], 4);
+				}
+			}
+		}
+	}
+	return pixels;
+}
+
+// Single level KTX2 for uncompressed pixels, enough for the engine's reader (no data format descriptor)
+inline list<uint8_t> writeKtx2(const VkFormat format, const uint32_t width, const uint32_t height,
+							   const uint8_t *pixels, const size_t size) {
+	constexpr size_t dataOffset = (sizeof(Ktx2Header) + sizeof(Ktx2Level) + 15) & ~size_t(15);
+
+	Ktx2Header header{};
+	memcpy(header.identifier, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+	header.vkFormat = format;
+	header.typeSize = 1;
+	header.pixelWidth = width;
+	header.pixelHeight = height;
+	header.faceCount = 1;
+	header.levelCount = 1;
+	header.supercompressionScheme = KTX2_SUPERCOMPRESSION_NONE;
+
+	const Ktx2Level level{.byteOffset = dataOffset, .byteLength = size, .uncompressedByteLength = size};
+
+	list<uint8_t> file(dataOffset + size, 0);
+	memcpy(file.data(), &header, sizeof(header));
+	memcpy(file.data() + sizeof(header), &level, sizeof(level));
+	memcpy(file.data() + dataOffset, pixels, size);
+	return file;
+}
@@ -0,0 +1,167 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include <stb/stb_image.h>
+
+#include "jobs.h"
+#include "staging.h"
+#include "utils.h"
+
+// stb_image allocates through these (see STBI_MALLOC in main.cpp). While a worker decodes, the first allocation with
+// the size of the RGBA output is served from the staging memory reserved for it, so the pixels are written where the
+// GPU copies them from. The JPEG decoder asks for one extra byte, hence the slack
+struct DecodeTarget {
+	static constexpr size_t SLACK = 1;
+
+	uint8_t *data = nullptr;
+	size_t size = 0;
+	bool taken = false;
+};
+
+inline thread_local DecodeTarget decodeTarget;
+
+inline bool isDecodeTarget(const void *pointer) { return decodeTarget.data && pointer == decodeTarget.data; }
+
+inline void *decodeMalloc(const size_t size) {
+	if (decodeTarget.data && !decodeTarget.taken && size >= decodeTarget.size &&
+		size <= decodeTarget.size + DecodeTarget::SLACK) {
+		decodeTarget.taken = true;
+		return decodeTarget.data;
+	}
+	return malloc(size);
+}
+
+inline void *decodeRealloc(void *pointer, const size_t size) {
+	if (!isDecodeTarget(pointer)) return realloc(pointer, size);
+
+	void *moved = malloc(size);
+	if (moved) memcpy(moved, pointer, std::min(size, decodeTarget.size));
+	return moved;
+}
+
+inline void decodeFree(void *pointer) {
+	if (!isDecodeTarget(pointer)) free(pointer);
+}
+
+struct LoadedImage {
+	std::string path;
+	uint32_t width = 0, height = 0;
+	std::optional<StagingRing::Allocation> staging;
+	std::string error;
+
+	LoadedImage *next = nullptr;
+};
+
+// Multiple producers single consumer: workers push with a compare and swap on the head, the render thread detaches
+// the whole list at once with an exchange, so neither side ever takes a lock
+class CompletionQueue {
+  public:
+	~CompletionQueue() {
+		drain([](LoadedImage &) {});
+	}
+
+	void push(LoadedImage *image) {
+		image->next = head.load(std::memory_order_relaxed);
+		while (!head.compare_exchange_weak(image->next, image, std::memory_order_release, std::memory_order_relaxed)) {
+		}
+	}
+
+	// Calls back oldest first, then frees the images
+	template <typename F> void drain(F &&callback) {
+		LoadedImage *newest = head.exchange(nullptr, std::memory_order_acquire);
+
+		LoadedImage *oldest = nullptr;
+		while (newest) {
+			LoadedImage *next = newest->next;
+			newest->next = oldest;
+			oldest = newest;
+			newest = next;
+		}
+
+		while (oldest) {
+			std::unique_ptr<LoadedImage> image(oldest);
+			oldest = oldest->next;
+			callback(*image);
+		}
+	}
+
+  private:
+	std::atomic<LoadedImage *> head = nullptr;
+};
+
+// Reads and decodes images on the job system, the render thread polls for finished ones and records their upload
+class AssetLoader {
+  public:
+	void create(JobSystem &jobs, StagingRing &stagingRing) {
+		this->jobs = &jobs;
+		this->stagingRing = &stagingRing;
+	}
+
+	void loadImage(const std::string &path) {
+		pending.fetch_add(1, std::memory_order_relaxed);
+		jobs->submit([this, path] {
+			completed.push(decodeImage(path).release());
+			pending.fetch_sub(1, std::memory_order_release);
+		});
+	}
+
+	template <typename F> void poll(F &&onLoaded) { completed.drain(onLoaded); }
+
+	size_t pendingCount() const { return pending.load(std::memory_order_acquire); }
+
+  private:
+	JobSystem *jobs = nullptr;
+	StagingRing *stagingRing = nullptr;
+	CompletionQueue completed;
+	std::atomic<size_t> pending = 0;
+
+	std::unique_ptr<LoadedImage> decodeImage(const std::string &path) {
+		auto image = std::make_unique<LoadedImage>();
+		image->path = path;
+
+		std::ifstream file(path, std::ios::ate | std::ios::binary);
+		if (!file.is_open()) {
+			image->error = "Failed to open file: " + path;
+			return image;
+		}
+		list<stbi_uc> encoded(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char *>(encoded.data()), static_cast<std::streamsize>(encoded.size()));
+
+		int width, height, channels;
+		if (!stbi_info_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height, &channels)) {
+			image->error = "Failed to read image header of " + path + ": " + stbi_failure_reason();
+			return image;
+		}
+		image->width = static_cast<uint32_t>(width);
+		image->height = static_cast<uint32_t>(height);
+
+		const size_t size = image->width * image->height * 4; // 4 bytes per pixel
+		image->staging = stagingRing->allocate(size + DecodeTarget::SLACK);
+		if (!image->staging) {
+			image->error = "Could not reserve staging memory for " + path + " (" + std::to_string(size) + " bytes)";
+			return image;
+		}
+
+		decodeTarget = {image->staging->data, size, false};
+		stbi_uc *pixels = stbi_load_from_memory(encoded.data(), static_cast<int>(encoded.size()), &width, &height,
+												&channels, STBI_rgb_alpha);
+		if (pixels && !isDecodeTarget(pixels)) {
+			// Output of a conversion pass the size check could not tell apart, the data still has to be moved
+			memcpy(image->staging->data, pixels, size);
+			stbi_image_free(pixels);
+		}
+		decodeTarget = {};
+
+		if (!pixels) image->error = "Failed to decode " + path + ": " + stbi_failure_reason();
+		return image;
+	}
+};
@@ -1,12 +1,18 @@
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <chrono>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <map>
 #include <optional>
 #include <set>
+#include <span>
+#include <string_view>
+#include <unordered_map>
 
 #define GLM_FORCE_RADIANS
 #include <glm/glm.hpp>
@@ -15,10 +21,50 @@
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
 
+#include "archive.h"
+#include "arena.h"
+#include "bench.h"
+#include "capture.h"
+#include "deletion.h"
+#include "descriptors.h"
+#include "device.h"
+#include "drawqueue.h"
+#include "golden.h"
+#include "initgraph.h"
+#include "input.h"
+#include "ktx2.h"
+#include "loader.h"
+#include "memory.h"
+#include "netplay.h"
+#include "objectcache.h"
+#include "pipeline.h"
+#include "png.h"
+#include "readback.h"
+#include "rendergraph.h"
+#include "shaders/embedded.h"
+#include "shaderwatcher.h"
+#include "simulation.h"
+#include "smalllist.h"
+#include "timeline.h"
+#include "utils.h"
+#include "vertex.h"
+
+// The decoder allocates through the loader so it can write straight into staging memory
 #define STB_IMAGE_IMPLEMENTATION
+#define STBI_MALLOC(size) decodeMalloc(size)
+#define STBI_REALLOC(pointer, size) decodeRealloc(pointer, size)
+#define STBI_FREE(pointer) decodeFree(pointer)
 #include <stb/stb_image.h>
 
-#include "utils.h"
+// Counted for the benchmark, the array and nothrow forms forward to these
+void *operator new(const size_t size) {
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	if (void *pointer = std::malloc(size)) return pointer;
+	throw std::bad_alloc();
+}
+
+void operator delete(void *pointer) noexcept { std::free(pointer); }
+void operator delete(void *pointer, [[gnu::unused]] const size_t size) noexcept { std::free(pointer); }
 
 #define SIZE(x) static_cast<uint32_t>(x.size())
 
@@ -26,15 +72,62 @@ constexpr int WIDTH = 800;
 constexpr int HEIGHT = 600;
 
 constexpr int MAX_FRAMES_IN_FLIGHT = 2;
+// Inline capacity of the per image lists, drivers hand out 2 to 4 images and more only moves them to the heap
+constexpr size_t MAX_SWAPCHAIN_IMAGES = 8;
+
+constexpr const char *TEXTURE_PATH = "textures/texture.jpg";
+constexpr const char *ARCHIVE_PATH = "assets.pak";
+
+constexpr const char *SHADER_DIRECTORY = "shaders";
+constexpr const char *GLSLC_PATH = "./shaderc/bin/glslc";
+
+constexpr VkDeviceSize STAGING_RING_SIZE = 64 << 20;
+
+// Enough for the draw commands of the 100k sprites benchmark scene
+constexpr size_t FRAME_ARENA_SIZE = 8 << 20;
+
+// Beyond the frames in flight, the slots left for the video encoder to hold on to while it catches up, so a capture
+// is only dropped when it falls behind by more than that
+constexpr uint32_t READBACK_SLOTS = MAX_FRAMES_IN_FLIGHT + 4;
+
+// Frames between two budget checks, and the share of the budget usage has to fall under before textures come back
+constexpr uint64_t MEMORY_POLICY_INTERVAL = 60;
+constexpr double MEMORY_LOW_WATERMARK = 0.75;
+
+struct KeyBinding {
+	int key;
+	Button button;
+};
+
+constexpr KeyBinding KEY_BINDINGS[] = {
+	{GLFW_KEY_UP, Button::Up},
+	{GLFW_KEY_DOWN, Button::Down},
+	{GLFW_KEY_LEFT, Button::Left},
+	{GLFW_KEY_RIGHT, Button::Right},
+	{GLFW_KEY_Z, Button::Shoot},
+	{GLFW_KEY_X, Button::Bomb},
+	{GLFW_KEY_LEFT_SHIFT, Button::Focus},
+	{GLFW_KEY_ESCAPE, Button::Quit},
+	{GLFW_KEY_F5, Button::ReloadTexture},
+	{GLFW_KEY_F3, Button::MemoryStats},
+};
+
+// As close to the process start as a static initializer gets
+static const auto processStart = std::chrono::steady_clock::now();
 
 const list<const char *> validationLayers = {"VK_LAYER_KHRONOS_validation"};
 #ifdef NDEBUG
 constexpr bool enableValidationLayers = false;
+constexpr bool enableShaderHotReload = false;
 #else
 constexpr bool enableValidationLayers = true;
+constexpr bool enableShaderHotReload = true;
 #endif
 
-const list<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+const list<const char *> deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME};
+
+// Layout used by the vertex buffer and the pipeline vertex input, swap for Vertex to debug precision issues
+using DrawVertex = PackedVertex;
 
 struct UniformBufferObject {
 	alignas(16) glm::mat4 model;
@@ -42,56 +135,6 @@ struct UniformBufferObject {
 	alignas(16) glm::mat4 proj;
 };
 
-struct Vertex {
-	glm::vec2 pos;
-	glm::vec3 color;
-	glm::vec2 texCoord;
-
-	static VkVertexInputBindingDescription getBindingDescription() {
-		return VkVertexInputBindingDescription{
-			.binding = 0,
-			.stride = sizeof(Vertex),
-			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
-		};
-	}
-
-	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
-		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{
-			VkVertexInputAttributeDescription{
-				.location = 0,
-				.binding = 0,
-				.format = VK_FORMAT_R32G32_SFLOAT,
-				.offset = offsetof(Vertex, pos),
-			},
-			VkVertexInputAttributeDescription{
-				.location = 1,
-				.binding = 0,
-				.format = VK_FORMAT_R32G32B32_SFLOAT,
-				.offset = offsetof(Vertex, color),
-			},
-			VkVertexInputAttributeDescription{
-				.location = 2,
-				.binding = 0,
-				.format = VK_FORMAT_R32G32_SFLOAT,
-				.offset = offsetof(Vertex, texCoord),
-			},
-		};
-		return attributeDescriptions;
-	}
-};
-
-struct QueueFamilyIndices {
-	std::optional<uint32_t> graphicsFamily, presentFamily;
-
-	bool isComplete() { return graphicsFamily.has_value() && presentFamily.has_value(); }
-};
-
-struct SwapChainSupportDetails {
-	VkSurfaceCapabilitiesKHR capabilities;
-	list<VkSurfaceFormatKHR> formats;
-	list<VkPresentModeKHR> presentModes;
-};
-
 static list<char> readFile(const std::string &filename) {
 	std::ifstream file(filename, std::ios::ate | std::ios::binary);
 	VALIDATE(file.is_open(), "Failed to open file: " + filename);
@@ -150,7 +193,25 @@ class TouhouEngine {
   public:
 	GLFWwindow *window;
 	VkInstance instance;
-	VkPipeline graphicsPipeline;
+	std::array<VkPipeline, BLEND_MODE_COUNT> blendPipelines;
+	// Declared before every member allocating from it, the draw queue and the descriptor set cache, so it outlives them
+	FrameArena frameArena{FRAME_ARENA_SIZE};
+	DrawQueue drawQueue;
+
+	VkPipelineCache pipelineCache;
+	VkShaderModule vertShaderModule, fragShaderModule;
+	std::unordered_map<PipelineKey, VkPipeline> pipelineVariants;
+
+	// Pipelines rebuilt by a worker from reloaded shader modules, swapped in at the start of a frame once ready
+	struct PipelineRebuild {
+		VkShaderModule vertShaderModule, fragShaderModule;
+		list<PipelineKey> keys;
+		list<VkPipeline> pipelines;
+		std::string error;
+	};
+	ShaderWatcher shaderWatcher;
+	std::optional<PipelineRebuild> pipelineRebuild;
+	std::atomic<bool> pipelineRebuildReady = false;
 
 	VkRenderPass renderPass;
 	VkPipelineLayout pipelineLayout;
@@ -159,34 +220,74 @@ class TouhouEngine {
 	list<VkCommandBuffer> commandBuffers;
 
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapChain;
+	VkSwapchainKHR swapChain = VK_NULL_HANDLE;
 
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
 
-	list<VkImage> swapChainImages;
-	list<VkImageView> swapChainImageViews;
-	list<VkFramebuffer> swapChainFramebuffer;
+	small_list<VkImage, MAX_SWAPCHAIN_IMAGES> swapChainImages;
+	small_list<VkImageView, MAX_SWAPCHAIN_IMAGES> swapChainImageViews;
+	small_list<VkFramebuffer, MAX_SWAPCHAIN_IMAGES> swapChainFramebuffer;
 
 	VkQueue graphicsQueue, presentQueue;
 	VkDevice device;
 
 	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	DeviceCapabilities capabilities;
+	MemoryTracker memory;
 	VkDebugUtilsMessengerEXT debugMessenger;
 
+	// Acquire and present only accept binary semaphores, everything else waits on the timeline
 	list<VkSemaphore> imageAvailableSemaphores;
 	list<VkSemaphore> renderFinishedSemaphores;
-	list<VkFence> waitFrameFences;
+
+	Timeline timeline;
+	std::array<uint64_t, MAX_FRAMES_IN_FLIGHT> frameTimelineValues{};
+	uint64_t uploadTimelineValue = 0;
+	DeletionQueue deletionQueue;
+
+	// Alike create infos get the same object. What the last reference is released to goes through the deletion queue
+	ObjectCache<SamplerKey, VkSampler> samplerCache;
+	ObjectCache<ImageViewKey, VkImageView> imageViewCache;
+	ObjectCache<DescriptorSetLayoutKey, VkDescriptorSetLayout> descriptorSetLayoutCache;
+
+	RenderGraph frameGraph;
+	RenderGraph::ResourceId backbuffer;
+	list<VkImage> frameGraphImages;
+	list<VkDeviceMemory> frameGraphImagesMemory;
 
 	uint32_t currentFrame = 0;
+	uint64_t frameCount = 0;
+	bool isRunning = false, isDrawing = false;
+	bool firstFramePresented = false;
+	uint32_t currentImageIndex = 0;
 	bool framebufferResized = false;
 
+	// Buttons pressed since the last tick, so a tap shorter than a tick still reaches the simulation
+	uint16_t latchedButtons = 0;
+	InputState previousInput;
+	uint64_t tickCount = 0;
+	bool quitRequested = false;
+	Simulation simulation;
+
+	Archive archive;
+	StagingRing stagingRing;
+	VkDeviceMemory stagingRingMemory;
+	AssetLoader assetLoader;
+	// Declared after everything its jobs use, so destroying it joins the workers before those go away
+	JobSystem jobs;
+
 	VkImage textureImage;
+	ImageDesc textureDesc;
 	VkDeviceMemory textureImageMemory;
 
 	VkImageView textureImageView;
 	VkSampler textureSampler;
 
+	// Levels dropped from the top of the mip chain, and whether the placeholder replaced the texture, to stay in budget
+	uint32_t textureMipBias = 0;
+	bool textureEvicted = false;
+
 	VkBuffer vertexBuffer, indexBuffer;
 	VkDeviceMemory vertexBufferMemory, indexBufferMemory;
 
@@ -194,19 +295,80 @@ class TouhouEngine {
 	list<VkDeviceMemory> uniformBuffersMemory;
 	list<void *> uniformBuffersMapped;
 
-	VkDescriptorPool descriptorPool;
 	VkDescriptorSetLayout descriptorSetLayout;
-	list<VkDescriptorSet> descriptorSets;
+	// Every set a frame binds comes from its allocator through the cache, and both start over once the frame in flight
+	// before it with the same index is done. A set is only written for the first draw needing its contents
+	std::array<DescriptorAllocator, MAX_FRAMES_IN_FLIGHT> frameDescriptors;
+	DescriptorSetCache frameDescriptorSets;
+
+	// Sprites queued every frame, each one quad of the vertex buffer, cycling through the pipeline variants and the
+	// textures. Texture 0 is the streamed one, the others only exist in benchmark scenes
+	struct SpriteTexture {
+		VkImage image;
+		VkDeviceMemory imageMemory;
+		VkImageView imageView;
+	};
+	uint32_t spriteCount = 1;
+	list<PipelineKey> spritePipelineKeys = {PipelineKey{}};
+	list<VkPipeline> spritePipelines = list<VkPipeline>(1);
+	list<SpriteTexture> spriteTextures;
+
+	// Set by --bench: no window, the swapchain comes from VK_EXT_headless_surface with the extent asked for
+	std::optional<std::string> benchReportPath;
+	bool headless = false;
+	bool benchFailed = false;
+	VkExtent2D headlessExtent = {WIDTH, HEIGHT};
+	double recordMilliseconds = 0.0;
+
+	// Set by --golden and --update-golden: frames are captured through the readback ring and compared against, or
+	// written to, the PNGs in the golden directory
+	std::optional<std::string> goldenDirectory;
+	bool updateGolden = false, goldenFailed = false;
+	std::string goldenScene;
+	uint32_t goldenFramesChecked = 0;
+
+	// Copies of the swapchain image after the scene pass, only added to the frame graph when captures are enabled
+	bool captureEnabled = false;
+	ReadbackRing readback;
+	VkDeviceMemory readbackMemory;
+	std::optional<uint64_t> captureFrameId;
+	std::optional<uint32_t> captureSlot;
+
+	// Set by --capture: every frame of the main loop is captured and encoded in the background, to a Y4M file when
+	// the path ends in .y4m and to a PNG sequence in the directory otherwise
+	std::optional<std::string> capturePath;
+	VideoEncoder videoEncoder;
+
+	// Set by --record and --replay: the input of every tick is written to the file, or read from it instead of the
+	// keyboard with exactly one tick per frame, so a replay renders the same frames on any machine
+	std::optional<std::string> recordPath, replayPath;
+	InputRecorder inputRecorder;
+	InputReplay inputReplay;
+
+	// Set by --host and --join: the simulation runs as one of two players, rolled back when the other's inputs arrive
+	std::optional<uint16_t> netplayPort;
+	std::optional<std::string> netplayHost;
+	UdpTransport udpTransport;
+	std::optional<RollbackSession> netplay;
+
+	// Animation time in seconds replacing the clock, so the same frame always renders the same image
+	std::optional<float> fixedTime;
 
 	void run() {
 		initWindow();
 		initVulkan();
-		mainLoop();
+		if (benchReportPath) {
+			runBenchmark();
+		} else if (goldenDirectory) {
+			runGoldenTest();
+		} else {
+			mainLoop();
+		}
 		cleanup();
 	}
 
   private:
-	const list<Vertex> vertices = {
+	const list<DrawVertex> vertices = {
 		{{-0.5f, -0.5f}, {1.0f, 0.0f, 0.0f}, {1.0f, 0.0f}},
 		{{0.5f, -0.5f}, {0.0f, 1.0f, 0.0f}, {0.0f, 0.0f}},
 		{{0.5f, 0.5f}, {0.0f, 0.0f, 1.0f}, {0.0f, 1.0f}},
@@ -215,11 +377,8 @@ class TouhouEngine {
 	const list<uint16_t> indices = {0, 1, 2, 2, 3, 0};
 
 	bool checkValidationLayerSupport() {
-		uint32_t layerCount;
-		vkEnumerateInstanceLayerProperties(&layerCount, VK_NULL_HANDLE);
-
-		list<VkLayerProperties> availableLayers(layerCount);
-		vkEnumerateInstanceLayerProperties(&layerCount, availableLayers.data());
+		small_list<VkLayerProperties, 32> availableLayers;
+		enumerate(availableLayers, vkEnumerateInstanceLayerProperties);
 
 		for (const char *layerName : validationLayers) {
 			if (std::none_of(availableLayers.begin(), availableLayers.end(),
@@ -261,6 +420,8 @@ class TouhouEngine {
 	}
 
 	void initWindow() {
+		if (headless) return;
+
 		LOG("Initializing window GLFW");
 		glfwInit();
 
@@ -272,6 +433,8 @@ class TouhouEngine {
 		window = glfwCreateWindow(WIDTH, HEIGHT, "Touhou Engine", VK_NULL_HANDLE, VK_NULL_HANDLE);
 		glfwSetWindowUserPointer(window, this);
 		glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+		glfwSetWindowRefreshCallback(window, windowRefreshCallback);
+		glfwSetKeyCallback(window, keyCallback);
 	}
 
 	static void framebufferResizeCallback(GLFWwindow *window, [[gnu::unused]] int width, [[gnu::unused]] int height) {
@@ -279,11 +442,25 @@ class TouhouEngine {
 		app->framebufferResized = true;
 	}
 
-	void verifyVkExtensions(list<const char *> glfwRequiredEXT) {
-		uint32_t vkExtensionCount = 0;
-		vkEnumerateInstanceExtensionProperties(VK_NULL_HANDLE, &vkExtensionCount, VK_NULL_HANDLE);
-		list<VkExtensionProperties> extensions(vkExtensionCount);
-		vkEnumerateInstanceExtensionProperties(VK_NULL_HANDLE, &vkExtensionCount, extensions.data());
+	static void keyCallback(GLFWwindow *window, const int key, [[gnu::unused]] int scancode, const int action,
+							[[gnu::unused]] int mods) {
+		if (action != GLFW_PRESS) return;
+
+		const auto app = reinterpret_cast<TouhouEngine *>(glfwGetWindowUserPointer(window));
+		for (const KeyBinding &binding : KEY_BINDINGS) {
+			if (binding.key == key) app->latchedButtons |= getButtonMask(binding.button);
+		}
+	}
+
+	// Some platforms block the event loop while the window is dragged, keep presenting frames from here meanwhile
+	static void windowRefreshCallback(GLFWwindow *window) {
+		const auto app = reinterpret_cast<TouhouEngine *>(glfwGetWindowUserPointer(window));
+		if (app->isRunning && !app->isDrawing) app->drawNextFrame();
+	}
+
+	void verifyVkExtensions(const list<const char *> &glfwRequiredEXT) {
+		small_list<VkExtensionProperties, 32> extensions;
+		enumerate(extensions, vkEnumerateInstanceExtensionProperties, static_cast<const char *>(nullptr));
 
 		const auto CONTAINS = [&extensions](const char *ext) {
 			return std::any_of(extensions.begin(), extensions.end(),
@@ -311,15 +488,20 @@ class TouhouEngine {
 			.apiVersion = VK_API_VERSION_1_0,
 		};
 
-		LOG("Obtaining required extensions for GLFW");
+		list<const char *> instanceExtensions = {VK_KHR_SURFACE_EXTENSION_NAME, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME};
+		if (!headless) {
+			LOG("Obtaining required extensions for GLFW");
 
-		uint32_t glfwExtensionCount = 0;
-		const char **glfwRequiredEXT = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			uint32_t glfwExtensionCount = 0;
+			const char **glfwRequiredEXT = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+			instanceExtensions.assign(glfwRequiredEXT, glfwRequiredEXT + glfwExtensionCount);
+		}
 
 		LOG("Checking for Validation Layers");
-		list<const char *> glfwExtensions(glfwRequiredEXT, glfwRequiredEXT + glfwExtensionCount);
+		// Required by VK_KHR_timeline_semaphore
+		instanceExtensions.push_back(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME);
 		if (enableValidationLayers) {
-			glfwExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
+			instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
 		}
 
 		VkInstanceCreateInfo createInfo{
@@ -329,8 +511,8 @@ class TouhouEngine {
 			.pApplicationInfo = &appInfo,
 			.enabledLayerCount = 0,
 			.ppEnabledLayerNames = VK_NULL_HANDLE,
-			.enabledExtensionCount = SIZE(glfwExtensions),
-			.ppEnabledExtensionNames = glfwExtensions.data(),
+			.enabledExtensionCount = SIZE(instanceExtensions),
+			.ppEnabledExtensionNames = instanceExtensions.data(),
 		};
 
 		VkDebugUtilsMessengerCreateInfoEXT debugCreateInfo;
@@ -342,7 +524,7 @@ class TouhouEngine {
 			createInfo.pNext = (VkDebugUtilsMessengerCreateInfoEXT *)&debugCreateInfo;
 		}
 
-		verifyVkExtensions(glfwExtensions);
+		verifyVkExtensions(instanceExtensions);
 
 		LOG("Creating Vulkan instance");
 		VK_CHECK(vkCreateInstance(&createInfo, VK_NULL_HANDLE, &instance), "Failed to create Vulkan instance");
@@ -351,108 +533,31 @@ class TouhouEngine {
 	}
 
 	void pickPhysicalDevice() {
-		uint32_t physicalDeviceCount = 0;
-		vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, VK_NULL_HANDLE);
-
-		list<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
-		vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices.data());
+		small_list<VkPhysicalDevice, 4> physicalDevices;
+		enumerate(physicalDevices, vkEnumeratePhysicalDevices, instance);
 
-		VALIDATE(physicalDeviceCount > 0, "No suitable GPU found!");
+		VALIDATE(!physicalDevices.empty(), "No suitable GPU found!");
 
-		std::multimap<int, VkPhysicalDevice> candidates;
+		std::multimap<int, DeviceCapabilities> candidates;
 		for (const auto &device : physicalDevices) {
-			int score = getDeviceScore(device);
-			candidates.insert(std::make_pair(score, device));
+			DeviceCapabilities deviceCapabilities = queryDeviceCapabilities(device, surface, deviceExtensions);
+			const int score = deviceCapabilities.getScore();
+			LOG("Device " << deviceCapabilities.properties.deviceName << " has a score of " << score);
+			candidates.emplace(score, std::move(deviceCapabilities));
 		}
 
 		LOG(candidates.size() << " GPUs found");
-		VALIDATE(candidates.rbegin()->first > 0, "Failed to find a suitable GPU score!");
-		physicalDevice = candidates.rbegin()->second;
-
-		VALIDATE(isDeviceSuitable(physicalDevice), "GPU is not suitable");
-		LOG("GPU successfully selected with a score of " << candidates.rbegin()->first);
-	}
-
-	QueueFamilyIndices findQueueFamilies(const VkPhysicalDevice device) {
-		uint32_t queueFamilyCount = 0;
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, VK_NULL_HANDLE);
-
-		list<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
-		vkGetPhysicalDeviceQueueFamilyProperties(device, &queueFamilyCount, queueFamilies.data());
-
-		QueueFamilyIndices indices;
-		for (uint32_t i = 0; i < queueFamilyCount && !indices.isComplete(); ++i) {
-			VkBool32 presentSupport = false;
-			vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &presentSupport);
-
-			if (presentSupport) {
-				indices.presentFamily = i;
-			}
-
-			if (queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
-				indices.graphicsFamily = i;
-			}
-		}
-		return indices;
-	}
-
-	bool isDeviceSuitable(const VkPhysicalDevice device) {
-		QueueFamilyIndices indices = findQueueFamilies(device);
-		const bool extensionsSupported = checkDeviceExtensionSupport(device);
-		bool swapChainAdequate = false;
-		if (extensionsSupported) {
-			SwapChainSupportDetails swapChainSupport = querySwapChainSupport(device);
-			swapChainAdequate = !swapChainSupport.formats.empty() && !swapChainSupport.presentModes.empty();
-		}
-		return swapChainAdequate && indices.isComplete();
-	}
-
-	bool checkDeviceExtensionSupport(const VkPhysicalDevice device) {
-		uint32_t extensionCount;
-		vkEnumerateDeviceExtensionProperties(device, VK_NULL_HANDLE, &extensionCount, VK_NULL_HANDLE);
-
-		list<VkExtensionProperties> availableExtensions(extensionCount);
-		vkEnumerateDeviceExtensionProperties(device, VK_NULL_HANDLE, &extensionCount, availableExtensions.data());
-
-		for (const auto &ext : deviceExtensions) {
-			if (std::none_of(availableExtensions.begin(), availableExtensions.end(),
-							 [&](const auto &extension) { return IS_STR_EQUAL(extension.extensionName, ext); })) {
-				return false;
-			}
-		}
-		return true;
-	}
-
-	int getDeviceScore(const VkPhysicalDevice device) {
-		LOG("Obtaining device properties");
-
-		VkPhysicalDeviceProperties deviceProperties;
-		vkGetPhysicalDeviceProperties(device, &deviceProperties);
-
-		VkPhysicalDeviceFeatures deviceFeatures;
-		vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
-
-		const char *deviceName = deviceProperties.deviceName;
-		LOG("Checking for geometry shader support for " << deviceName);
+		VALIDATE(candidates.rbegin()->first > 0, "Failed to find a suitable GPU!");
+		capabilities = std::move(candidates.rbegin()->second);
+		physicalDevice = capabilities.physicalDevice;
 
-		if (!deviceFeatures.geometryShader) return 0;
-
-		int score = 0;
-		LOG("Checking for GPU type for " << deviceName);
-		if (deviceProperties.deviceType == VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU) {
-			score += 1000;
-		}
-
-		score += deviceProperties.limits.maxImageDimension2D;
-
-		LOG("Device " << deviceName << " has a score of " << score);
-
-		return score;
+		LOG("GPU " << capabilities.properties.deviceName << " successfully selected with a score of "
+				   << candidates.rbegin()->first);
 	}
 
 	void createLogicalDevice() {
 		LOG("Creating logical device");
-		const QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+		const QueueFamilyIndices &indices = capabilities.queueFamilyIndices;
 
 		list<VkDeviceQueueCreateInfo> queueCreateInfos;
 		const std::set<uint32_t> uniqueQueueFamilies = {indices.graphicsFamily.value(), indices.presentFamily.value()};
@@ -470,16 +575,26 @@ class TouhouEngine {
 			queueCreateInfos.push_back(queueCreateInfo);
 		}
 
+		VkPhysicalDeviceTimelineSemaphoreFeaturesKHR timelineFeatures{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_TIMELINE_SEMAPHORE_FEATURES_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.timelineSemaphore = VK_TRUE,
+		};
+
+		list<const char *> enabledExtensions = deviceExtensions;
+		const bool hasMemoryBudget = capabilities.hasExtension(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		if (hasMemoryBudget) enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+
 		VkDeviceCreateInfo createInfo{
 			.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
+			.pNext = &timelineFeatures,
 			.flags = 0,
 			.queueCreateInfoCount = SIZE(queueCreateInfos),
 			.pQueueCreateInfos = queueCreateInfos.data(),
 			.enabledLayerCount = 0,
 			.ppEnabledLayerNames = VK_NULL_HANDLE,
-			.enabledExtensionCount = SIZE(deviceExtensions),
-			.ppEnabledExtensionNames = deviceExtensions.data(),
+			.enabledExtensionCount = SIZE(enabledExtensions),
+			.ppEnabledExtensionNames = enabledExtensions.data(),
 			.pEnabledFeatures = VK_NULL_HANDLE,
 		};
 
@@ -497,40 +612,50 @@ class TouhouEngine {
 		LOG("Obtaining presentFamily queue");
 		vkGetDeviceQueue(device, indices.presentFamily.value(), 0, &presentQueue);
 
+		memory.create(instance, physicalDevice, device, capabilities.memoryProperties, hasMemoryBudget);
+
 		LOG("Logical device created");
 	}
 
 	void createWindowSurface() {
+		if (headless) {
+			createHeadlessSurface();
+			return;
+		}
+
 		LOG("Creating window surface");
 		VK_CHECK(glfwCreateWindowSurface(instance, window, VK_NULL_HANDLE, &surface),
 				 "Failed to create window surface!");
 		LOG("Window surface created");
 	}
 
-	SwapChainSupportDetails querySwapChainSupport(const VkPhysicalDevice device) {
-		SwapChainSupportDetails details;
-		vkGetPhysicalDeviceSurfaceCapabilitiesKHR(device, surface, &details.capabilities);
+	void createHeadlessSurface() {
+		LOG("Creating headless surface");
+		const auto createSurface =
+			(PFN_vkCreateHeadlessSurfaceEXT)vkGetInstanceProcAddr(instance, "vkCreateHeadlessSurfaceEXT");
+		VALIDATE(createSurface, "Missing VK_EXT_headless_surface!");
 
-		uint32_t formatCount;
-		vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, VK_NULL_HANDLE);
-
-		if (formatCount != 0) {
-			details.formats.resize(formatCount);
-			vkGetPhysicalDeviceSurfaceFormatsKHR(device, surface, &formatCount, details.formats.data());
-		}
+		const VkHeadlessSurfaceCreateInfoEXT createInfo{
+			.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+		};
 
-		uint32_t presentModeCount;
-		vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, VK_NULL_HANDLE);
+		VK_CHECK(createSurface(instance, &createInfo, VK_NULL_HANDLE, &surface), "Failed to create headless surface!");
+		LOG("Headless surface created");
+	}
 
-		if (presentModeCount != 0) {
-			details.presentModes.resize(presentModeCount);
-			vkGetPhysicalDeviceSurfacePresentModesKHR(device, surface, &presentModeCount, details.presentModes.data());
+	// The headless surface has no window, its size is whatever the benchmark asks for
+	void getFramebufferSize(int &width, int &height) {
+		if (headless) {
+			width = static_cast<int>(headlessExtent.width);
+			height = static_cast<int>(headlessExtent.height);
+			return;
 		}
-
-		return details;
+		glfwGetFramebufferSize(window, &width, &height);
 	}
 
-	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const list<VkSurfaceFormatKHR> &availableFormats) {
+	VkSurfaceFormatKHR chooseSwapSurfaceFormat(const pmr_list<VkSurfaceFormatKHR> &availableFormats) {
 		for (const auto &availableFormat : availableFormats) {
 			if (availableFormat.format == VK_FORMAT_B8G8R8A8_SRGB &&
 				availableFormat.colorSpace == VK_COLOR_SPACE_SRGB_NONLINEAR_KHR) {
@@ -540,7 +665,7 @@ class TouhouEngine {
 		return availableFormats[0];
 	}
 
-	VkPresentModeKHR chooseSwapPresentMode(const list<VkPresentModeKHR> &availablePresentModes) {
+	VkPresentModeKHR chooseSwapPresentMode(const pmr_list<VkPresentModeKHR> &availablePresentModes) {
 		for (const auto &availablePresentMode : availablePresentModes) {
 			if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
 				return availablePresentMode;
@@ -555,7 +680,7 @@ class TouhouEngine {
 		}
 
 		int width, height;
-		glfwGetFramebufferSize(window, &width, &height);
+		getFramebufferSize(width, height);
 
 		VkExtent2D actualExtent = {
 			static_cast<uint32_t>(width),
@@ -572,13 +697,21 @@ class TouhouEngine {
 
 	void createSwapChain() {
 		LOG("Querying swap chain support details for creation");
-		const SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice);
+		// Queried again since the surface extent changes with the window
+		const SwapChainSupportDetails swapChainSupport = querySwapChainSupport(physicalDevice, surface, &frameArena);
 
 		LOG("Choosing swap chain details");
 		const VkSurfaceFormatKHR surfaceFormat = chooseSwapSurfaceFormat(swapChainSupport.formats);
 		const VkPresentModeKHR presentMode = chooseSwapPresentMode(swapChainSupport.presentModes);
 		const VkExtent2D extent = chooseSwapExtent(swapChainSupport.capabilities);
 
+		VkImageUsageFlags imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+		if (captureEnabled) {
+			VALIDATE(swapChainSupport.capabilities.supportedUsageFlags & VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+					 "Swap chain images cannot be copied from, captures are not supported!");
+			imageUsage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+		}
+
 		VkSwapchainCreateInfoKHR createInfo{
 			.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR,
 			.pNext = VK_NULL_HANDLE,
@@ -590,7 +723,7 @@ class TouhouEngine {
 			.imageColorSpace = surfaceFormat.colorSpace,
 			.imageExtent = extent,
 			.imageArrayLayers = 1,
-			.imageUsage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT,
+			.imageUsage = imageUsage,
 
 			.imageSharingMode = VK_SHARING_MODE_EXCLUSIVE,
 
@@ -603,13 +736,14 @@ class TouhouEngine {
 			.presentMode = presentMode,
 			.clipped = VK_TRUE,
 
-			.oldSwapchain = VK_NULL_HANDLE,
+			// Lets the driver reuse the resources of the swapchain being replaced, if any
+			.oldSwapchain = swapChain,
 		};
 
-		const QueueFamilyIndices indices = findQueueFamilies(physicalDevice);
+		const QueueFamilyIndices &indices = capabilities.queueFamilyIndices;
 
+		const uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 		if (indices.graphicsFamily != indices.presentFamily) {
-			const uint32_t queueFamilyIndices[] = {indices.graphicsFamily.value(), indices.presentFamily.value()};
 			createInfo.imageSharingMode = VK_SHARING_MODE_CONCURRENT;
 			createInfo.queueFamilyIndexCount = 2;
 			createInfo.pQueueFamilyIndices = queueFamilyIndices;
@@ -625,16 +759,12 @@ class TouhouEngine {
 		swapChainExtent = extent;
 
 		LOG("Obtaining swap chain images");
-		uint32_t imageCount;
-		vkGetSwapchainImagesKHR(device, swapChain, &imageCount, VK_NULL_HANDLE);
-
-		swapChainImages.resize(imageCount);
-		vkGetSwapchainImagesKHR(device, swapChain, &imageCount, swapChainImages.data());
+		enumerate(swapChainImages, vkGetSwapchainImagesKHR, device, swapChain);
 
 		LOG("Swap chain images obtained");
 	}
 
-	VkImageView createImageView(VkImage image, VkFormat format) {
+	VkImageView createImageView(VkImage image, VkFormat format, uint32_t mipLevels = 1) {
 		LOG("Creating image view");
 		const VkImageViewCreateInfo createInfo{
 			.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO,
@@ -656,19 +786,53 @@ class TouhouEngine {
 				{
 					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
 					.baseMipLevel = 0,
-					.levelCount = 1,
+					.levelCount = mipLevels,
 					.baseArrayLayer = 0,
 					.layerCount = 1,
 				},
 		};
 
-		VkImageView imageView;
-		VK_CHECK(vkCreateImageView(device, &createInfo, VK_NULL_HANDLE, &imageView), "Failed to create image views!");
+		const VkImageView imageView = imageViewCache.acquire(ImageViewKey::fromCreateInfo(createInfo), [&] {
+			VkImageView view;
+			VK_CHECK(vkCreateImageView(device, &createInfo, VK_NULL_HANDLE, &view), "Failed to create image views!");
+			return view;
+		});
 		LOG("Image view created");
 
 		return imageView;
 	}
 
+	// The release functions destroy the object with its last reference, so they are only called once nothing in
+	// flight uses it anymore: from a deletion queue entry, or with the device idle
+	void releaseImageView(const VkImageView imageView) {
+		if (imageViewCache.release(imageView)) vkDestroyImageView(device, imageView, VK_NULL_HANDLE);
+	}
+
+	VkSampler acquireSampler(const VkSamplerCreateInfo &createInfo) {
+		return samplerCache.acquire(SamplerKey::fromCreateInfo(createInfo), [&] {
+			VkSampler sampler;
+			VK_CHECK(vkCreateSampler(device, &createInfo, VK_NULL_HANDLE, &sampler), "Failed to create sampler!");
+			return sampler;
+		});
+	}
+
+	void releaseSampler(const VkSampler sampler) {
+		if (samplerCache.release(sampler)) vkDestroySampler(device, sampler, VK_NULL_HANDLE);
+	}
+
+	VkDescriptorSetLayout acquireDescriptorSetLayout(const VkDescriptorSetLayoutCreateInfo &createInfo) {
+		return descriptorSetLayoutCache.acquire(DescriptorSetLayoutKey::fromCreateInfo(createInfo), [&] {
+			VkDescriptorSetLayout layout;
+			VK_CHECK(vkCreateDescriptorSetLayout(device, &createInfo, VK_NULL_HANDLE, &layout),
+					 "Failed to create descriptor set layout!");
+			return layout;
+		});
+	}
+
+	void releaseDescriptorSetLayout(const VkDescriptorSetLayout layout) {
+		if (descriptorSetLayoutCache.release(layout)) vkDestroyDescriptorSetLayout(device, layout, VK_NULL_HANDLE);
+	}
+
 	void createImageViews() {
 		LOG("Creating image views");
 		swapChainImageViews.resize(swapChainImages.size());
@@ -678,15 +842,15 @@ class TouhouEngine {
 		}
 	}
 
-	VkShaderModule createShaderModule(const list<char> &code) {
+	VkShaderModule createShaderModule(const std::span<const uint32_t> code) {
 		LOG("Creating shader module");
 
 		const VkShaderModuleCreateInfo createInfo{
 			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
 			.pNext = VK_NULL_HANDLE,
 			.flags = 0,
-			.codeSize = code.size(),
-			.pCode = reinterpret_cast<const uint32_t *>(code.data()),
+			.codeSize = code.size_bytes(),
+			.pCode = code.data(),
 		};
 
 		VkShaderModule shaderModule;
@@ -696,21 +860,59 @@ class TouhouEngine {
 		return shaderModule;
 	}
 
-	void createGraphicsPipeline() {
-		LOG("Initializing graphics pipeline creation");
+	void createShaderModules() {
+		LOG("Loading shader modules");
+
+		// Embedded at build time, see EMBEDDED_SHADERS in the Makefile
+		vertShaderModule = createShaderModule(SHADER_VERT_SPV);
+		fragShaderModule = createShaderModule(SHADER_FRAG_SPV);
+
+		LOG("Shader modules loaded");
+	}
+
+	void createPipelineLayout() {
+		LOG("Initializing graphics pipeline layout creation");
+
+		const VkPipelineLayoutCreateInfo pipelineLayoutInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.setLayoutCount = 1,
+			.pSetLayouts = &descriptorSetLayout,
+			.pushConstantRangeCount = 0,
+			.pPushConstantRanges = VK_NULL_HANDLE,
+		};
+
+		LOG("Creating graphics pipeline layout");
+		VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, VK_NULL_HANDLE, &pipelineLayout),
+				 "Failed to create pipeline layout!");
+
+		LOG("Creating pipeline cache");
+		const VkPipelineCacheCreateInfo pipelineCacheInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.initialDataSize = 0,
+			.pInitialData = VK_NULL_HANDLE,
+		};
+
+		VK_CHECK(vkCreatePipelineCache(device, &pipelineCacheInfo, VK_NULL_HANDLE, &pipelineCache),
+				 "Failed to create pipeline cache!");
+	}
 
-		const auto vertShaderCode = readFile("shaders/shader_vert.spv");
-		const auto fragShaderCode = readFile("shaders/shader_frag.spv");
+	// Also called from worker threads when shaders are reloaded, so it only reads state fixed after initialization
+	VkPipeline createGraphicsPipeline(const PipelineKey &key, const VkShaderModule vertModule,
+									  const VkShaderModule fragModule) {
+		LOG("Initializing graphics pipeline creation");
 
-		const VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
-		const VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
+		const PipelineSpecialization specialization(key);
 
 		const VkPipelineShaderStageCreateInfo vertShaderStageInfo{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 			.pNext = VK_NULL_HANDLE,
 			.flags = 0,
 			.stage = VK_SHADER_STAGE_VERTEX_BIT,
-			.module = vertShaderModule,
+			.module = vertModule,
 			.pName = "main",
 			.pSpecializationInfo = VK_NULL_HANDLE,
 		};
@@ -720,9 +922,9 @@ class TouhouEngine {
 			.pNext = VK_NULL_HANDLE,
 			.flags = 0,
 			.stage = VK_SHADER_STAGE_FRAGMENT_BIT,
-			.module = fragShaderModule,
+			.module = fragModule,
 			.pName = "main",
-			.pSpecializationInfo = VK_NULL_HANDLE,
+			.pSpecializationInfo = &specialization.info,
 		};
 
 		const VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo, fragShaderStageInfo};
@@ -736,18 +938,8 @@ class TouhouEngine {
 			.pDynamicStates = dynamicStates.data(),
 		};
 
-		const auto bindingDescriptions = Vertex::getBindingDescription();
-		const auto attributeDescriptions = Vertex::getAttributeDescriptions();
-
-		const VkPipelineVertexInputStateCreateInfo vertexInputInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.vertexBindingDescriptionCount = 1,
-			.pVertexBindingDescriptions = &bindingDescriptions,
-			.vertexAttributeDescriptionCount = SIZE(attributeDescriptions),
-			.pVertexAttributeDescriptions = attributeDescriptions.data(),
-		};
+		const VertexInputState<DrawVertex> vertexInputState;
+		const VkPipelineVertexInputStateCreateInfo vertexInputInfo = vertexInputState.createInfo();
 
 		const VkPipelineInputAssemblyStateCreateInfo inputAssembly{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO,
@@ -801,22 +993,7 @@ class TouhouEngine {
 			.alphaToOneEnable = VK_FALSE,
 		};
 
-		// finalColor.rgb = newColor.rgb * newColor.a + oldColor.rgb * (1 - newColor.a)
-		// finalColor.a = newColor.a * 1 + oldColor.a * 0
-		const VkPipelineColorBlendAttachmentState colorBlendAttachment{
-			.blendEnable = VK_TRUE,
-
-			.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
-			.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
-			.colorBlendOp = VK_BLEND_OP_ADD,
-
-			.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
-			.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
-			.alphaBlendOp = VK_BLEND_OP_ADD,
-
-			.colorWriteMask = VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT |
-							  VK_COLOR_COMPONENT_A_BIT,
-		};
+		const VkPipelineColorBlendAttachmentState colorBlendAttachment = getBlendAttachmentState(key.blendMode);
 
 		const VkPipelineColorBlendStateCreateInfo colorBlending{
 			.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO,
@@ -829,20 +1006,6 @@ class TouhouEngine {
 			.blendConstants = {0.0f, 0.0f, 0.0f, 0.0f},
 		};
 
-		const VkPipelineLayoutCreateInfo pipelineLayoutInfo{
-			.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.setLayoutCount = 1,
-			.pSetLayouts = &descriptorSetLayout,
-			.pushConstantRangeCount = 0,
-			.pPushConstantRanges = VK_NULL_HANDLE,
-		};
-
-		LOG("Creating graphics pipeline layout");
-		VK_CHECK(vkCreatePipelineLayout(device, &pipelineLayoutInfo, VK_NULL_HANDLE, &pipelineLayout),
-				 "Failed to create pipeline layout!");
-
 		const VkGraphicsPipelineCreateInfo pipelineInfo{
 			.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO,
 			.pNext = VK_NULL_HANDLE,
@@ -870,14 +1033,125 @@ class TouhouEngine {
 		};
 
 		LOG("Creating graphics pipeline");
-		VK_CHECK(vkCreateGraphicsPipelines(device, VK_NULL_HANDLE, 1, &pipelineInfo, VK_NULL_HANDLE, &graphicsPipeline),
+		VkPipeline pipeline;
+		VK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, VK_NULL_HANDLE, &pipeline),
 				 "Failed to create graphics pipeline!");
 
-		LOG("Graphics pipeline created, now liberating resources");
-		vkDestroyShaderModule(device, fragShaderModule, VK_NULL_HANDLE);
-		vkDestroyShaderModule(device, vertShaderModule, VK_NULL_HANDLE);
+		LOG("Graphics pipeline created");
+		return pipeline;
+	}
+
+	VkPipeline getPipeline(const PipelineKey &key) {
+		const auto it = pipelineVariants.find(key);
+		if (it != pipelineVariants.end()) return it->second;
+
+		LOG("Building pipeline variant " << pipelineVariants.size());
+		return pipelineVariants[key] = createGraphicsPipeline(key, vertShaderModule, fragShaderModule);
+	}
+
+	void startShaderWatcher() {
+		if (!shaderWatcher.start(SHADER_DIRECTORY, GLSLC_PATH)) LOGE("Failed to watch " << SHADER_DIRECTORY);
+	}
+
+	// Called at the start of a frame. New modules are built into pipelines on a worker, and the pipelines they
+	// replace are retired through the deletion queue, so neither the render thread nor the GPU is ever stalled
+	void updateShaders() {
+		if (pipelineRebuild) {
+			if (!pipelineRebuildReady.load(std::memory_order_acquire)) return;
+			swapRebuiltPipelines();
+		}
+
+		VkShaderModule vertModule = vertShaderModule, fragModule = fragShaderModule;
+		for (const CompiledShader &shader : shaderWatcher.takeCompiled()) {
+			if (shader.code.empty()) {
+				LOGE("Failed to compile " << shader.source << ":\n" << shader.log);
+				continue;
+			}
+
+			VkShaderModule &module = shader.stage == VK_SHADER_STAGE_VERTEX_BIT ? vertModule : fragModule;
+			const VkShaderModule current =
+				shader.stage == VK_SHADER_STAGE_VERTEX_BIT ? vertShaderModule : fragShaderModule;
+			// The same stage can be compiled twice in a batch, only the latest module is kept
+			if (module != current) vkDestroyShaderModule(device, module, VK_NULL_HANDLE);
+			module = createShaderModule(shader.code);
+		}
+		if (vertModule == vertShaderModule && fragModule == fragShaderModule) return;
+
+		// Every variant uses both stages, so all of them are affected
+		pipelineRebuild = PipelineRebuild{vertModule, fragModule, {}, {}, {}};
+		for (const auto &[key, pipeline] : pipelineVariants) {
+			pipelineRebuild->keys.push_back(key);
+		}
+
+		LOG("Rebuilding " << pipelineRebuild->keys.size() << " pipelines");
+		pipelineRebuildReady.store(false, std::memory_order_relaxed);
+		jobs.submit([this] {
+			PipelineRebuild &rebuild = *pipelineRebuild;
+			try {
+				for (const PipelineKey &key : rebuild.keys) {
+					rebuild.pipelines.push_back(
+						createGraphicsPipeline(key, rebuild.vertShaderModule, rebuild.fragShaderModule));
+				}
+			} catch (const std::exception &e) {
+				rebuild.error = e.what();
+			}
+			pipelineRebuildReady.store(true, std::memory_order_release);
+		});
+	}
+
+	void swapRebuiltPipelines() {
+		if (!pipelineRebuild->error.empty()) {
+			LOGE("Failed to rebuild pipelines: " << pipelineRebuild->error);
+			discardPipelineRebuild();
+			return;
+		}
+
+		const uint64_t lastUse = timeline.lastSubmitted();
+		for (const auto &[key, pipeline] : pipelineVariants) {
+			deletionQueue.push(lastUse, [this, pipeline] { vkDestroyPipeline(device, pipeline, VK_NULL_HANDLE); });
+		}
+
+		// Variants created while the rebuild was running used the old modules, they are dropped and built again
+		// on their next use
+		pipelineVariants.clear();
+		for (size_t i = 0; i < pipelineRebuild->keys.size(); ++i) {
+			pipelineVariants[pipelineRebuild->keys[i]] = pipelineRebuild->pipelines[i];
+		}
+
+		// Pipelines keep working after the modules they were created from are destroyed
+		if (pipelineRebuild->vertShaderModule != vertShaderModule) {
+			vkDestroyShaderModule(device, vertShaderModule, VK_NULL_HANDLE);
+		}
+		if (pipelineRebuild->fragShaderModule != fragShaderModule) {
+			vkDestroyShaderModule(device, fragShaderModule, VK_NULL_HANDLE);
+		}
+		vertShaderModule = pipelineRebuild->vertShaderModule;
+		fragShaderModule = pipelineRebuild->fragShaderModule;
+
+		createBlendPipelines();
+		pipelineRebuild.reset();
+		LOG("Swapped in rebuilt pipelines");
+	}
+
+	// Only valid once the worker is done with the rebuild, or never started it
+	void discardPipelineRebuild() {
+		for (const VkPipeline pipeline : pipelineRebuild->pipelines) {
+			vkDestroyPipeline(device, pipeline, VK_NULL_HANDLE);
+		}
+		if (pipelineRebuild->vertShaderModule != vertShaderModule) {
+			vkDestroyShaderModule(device, pipelineRebuild->vertShaderModule, VK_NULL_HANDLE);
+		}
+		if (pipelineRebuild->fragShaderModule != fragShaderModule) {
+			vkDestroyShaderModule(device, pipelineRebuild->fragShaderModule, VK_NULL_HANDLE);
+		}
+		pipelineRebuild.reset();
+	}
 
-		LOG("Shader modules destroyed");
+	void createBlendPipelines() {
+		LOG("Creating blend mode pipeline set");
+		for (size_t i = 0; i < BLEND_MODE_COUNT; ++i) {
+			blendPipelines[i] = getPipeline(PipelineKey{.blendMode = static_cast<BlendMode>(i)});
+		}
 	}
 
 	void createRenderPass() {
@@ -895,8 +1169,9 @@ class TouhouEngine {
 			.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 			.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
 
-			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
-			.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
+			// Layout transitions in and out of the pass are scheduled by the frame graph
+			.initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+			.finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
 		};
 
 		const VkAttachmentReference colorAttachmentRef{
@@ -964,7 +1239,7 @@ class TouhouEngine {
 	void createCommandPool() {
 		LOG("Creating command pool");
 
-		const QueueFamilyIndices queueFamilyIndices = findQueueFamilies(physicalDevice);
+		const QueueFamilyIndices &queueFamilyIndices = capabilities.queueFamilyIndices;
 
 		const VkCommandPoolCreateInfo poolInfo{
 			.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -997,23 +1272,76 @@ class TouhouEngine {
 		LOG("Command buffer created");
 	}
 
-	void recordCommandBuffer(const VkCommandBuffer commandBuffer, const uint32_t imageIndex) {
-		const VkCommandBufferBeginInfo beginInfo{
-			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.pInheritanceInfo = VK_NULL_HANDLE,
-		};
+	void queueDraws() {
+		drawQueue.reset(&frameArena, spriteCount);
 
-		VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo), "Failed to begin recording command buffer!");
+		// Looked up once per frame, a shader reload may have replaced the variants since the previous one
+		for (size_t i = 0; i < spritePipelineKeys.size(); ++i) {
+			spritePipelines[i] = getPipeline(spritePipelineKeys[i]);
+		}
+
+		// Looked up once per texture rather than per sprite
+		const uint32_t textureCount = SIZE(spriteTextures) + 1;
+		pmr_list<VkDescriptorSet> textureSets(&frameArena);
+		textureSets.reserve(textureCount);
+		textureSets.push_back(getTextureDescriptorSet(textureImageView));
+		for (const SpriteTexture &texture : spriteTextures) {
+			textureSets.push_back(getTextureDescriptorSet(texture.imageView));
+		}
+
+		for (uint32_t i = 0; i < spriteCount; ++i) {
+			const uint32_t variant = i % SIZE(spritePipelineKeys), texture = i % textureCount;
+			drawQueue.push(DrawCommand{
+				.layer = 0,
+				.pipelineId = static_cast<uint8_t>(variant),
+				.texture = static_cast<uint16_t>(texture),
+				.depth = 0.0f,
+				.pipeline = spritePipelines[variant],
+				.descriptorSet = textureSets[texture],
+				.indexCount = SIZE(indices),
+				.firstIndex = 0,
+				.vertexOffset = static_cast<int32_t>(i * 4),
+			});
+		}
+	}
+
+	void createFrameGraph() {
+		LOG("Creating frame graph");
+
+		// The acquire semaphore is waited on at the color attachment output stage, so the first transition chains to it
+		backbuffer = frameGraph.importImage(
+			"backbuffer", {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED},
+			ResourceUsage::Present);
+
+		frameGraph.addPass("scene", {}, {{backbuffer, ResourceUsage::ColorAttachment}},
+						   [this](const VkCommandBuffer commandBuffer) { recordScenePass(commandBuffer); });
+		if (captureEnabled) {
+			frameGraph.addPass("capture", {{backbuffer, ResourceUsage::TransferSrc}}, {},
+							   [this](const VkCommandBuffer commandBuffer) { recordCapturePass(commandBuffer); });
+		}
+
+		frameGraph.compile();
 
+		const auto &physicalImages = frameGraph.getPhysicalImages();
+		frameGraphImages.resize(physicalImages.size());
+		frameGraphImagesMemory.resize(physicalImages.size());
+		for (size_t i = 0; i < physicalImages.size(); ++i) {
+			createImage(physicalImages[i], frameGraphImages[i], frameGraphImagesMemory[i],
+						MemoryCategory::RenderTargets);
+			frameGraph.setPhysicalImage(i, frameGraphImages[i]);
+		}
+
+		LOG("Frame graph created");
+	}
+
+	void recordScenePass(const VkCommandBuffer commandBuffer) {
 		const VkClearValue clearColor = {0.0f, 0.0f, 0.0f, 1.0f};
 
 		const VkRenderPassBeginInfo renderPassInfo{
 			.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
 			.pNext = VK_NULL_HANDLE,
 			.renderPass = renderPass,
-			.framebuffer = swapChainFramebuffer[imageIndex],
+			.framebuffer = swapChainFramebuffer[currentImageIndex],
 			.renderArea =
 				{
 					.offset = {0, 0},
@@ -1025,8 +1353,6 @@ class TouhouEngine {
 
 		vkCmdBeginRenderPass(commandBuffer, &renderPassInfo, VK_SUBPASS_CONTENTS_INLINE);
 
-		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
-
 		const VkDeviceSize offsets[1] = {0};
 		vkCmdBindVertexBuffers(commandBuffer, 0, 1, &vertexBuffer, offsets);
 		vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0, VK_INDEX_TYPE_UINT16);
@@ -1049,12 +1375,34 @@ class TouhouEngine {
 
 		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 
-		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1,
-								&descriptorSets[currentFrame], 0, VK_NULL_HANDLE);
-
-		vkCmdDrawIndexed(commandBuffer, SIZE(indices), 1, 0, 0, 0);
+		drawQueue.sort();
+		drawQueue.record(commandBuffer, pipelineLayout);
 
 		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	void recordCapturePass(const VkCommandBuffer commandBuffer) {
+		if (!captureFrameId) return;
+
+		captureSlot = readback.record(commandBuffer, swapChainImages[currentImageIndex], swapChainExtent,
+									  swapChainImageFormat, *captureFrameId);
+		if (!captureSlot) LOG("No readback slot for frame " << *captureFrameId << ", capture dropped");
+		captureFrameId.reset();
+	}
+
+	void recordCommandBuffer(const VkCommandBuffer commandBuffer, const uint32_t imageIndex) {
+		const VkCommandBufferBeginInfo beginInfo{
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.pInheritanceInfo = VK_NULL_HANDLE,
+		};
+
+		VK_CHECK(vkBeginCommandBuffer(commandBuffer, &beginInfo), "Failed to begin recording command buffer!");
+
+		currentImageIndex = imageIndex;
+		frameGraph.setImage(backbuffer, swapChainImages[imageIndex]);
+		frameGraph.execute(commandBuffer);
 
 		VK_CHECK(vkEndCommandBuffer(commandBuffer), "Failed to record command buffer!");
 	}
@@ -1063,41 +1411,24 @@ class TouhouEngine {
 		LOG("Creating synchronization objects");
 		imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 		renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
-		waitFrameFences.resize(MAX_FRAMES_IN_FLIGHT);
 
 		VkSemaphoreCreateInfo semaphoreInfo{
 			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
 			.pNext = VK_NULL_HANDLE,
 			.flags = 0,
 		};
-		VkFenceCreateInfo fenceInfo{
-			.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.flags = VK_FENCE_CREATE_SIGNALED_BIT,
-		};
 
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
 			if (vkCreateSemaphore(device, &semaphoreInfo, VK_NULL_HANDLE, &imageAvailableSemaphores[i]) != VK_SUCCESS ||
-				vkCreateSemaphore(device, &semaphoreInfo, VK_NULL_HANDLE, &renderFinishedSemaphores[i]) != VK_SUCCESS ||
-				vkCreateFence(device, &fenceInfo, VK_NULL_HANDLE, &waitFrameFences[i]) != VK_SUCCESS) {
+				vkCreateSemaphore(device, &semaphoreInfo, VK_NULL_HANDLE, &renderFinishedSemaphores[i]) != VK_SUCCESS) {
 				ERROR("Failed to create synchronization objects for a frame!");
 			}
 		}
 
-		LOG("Synchronization objects created");
-	}
-
-	uint32_t findMemoryType(const uint32_t typeFilter, const VkMemoryPropertyFlags properties) {
-		VkPhysicalDeviceMemoryProperties memoryProperties;
-		vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
-
-		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
-			if (typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
-				return i;
-			}
-		}
+		LOG("Creating timeline semaphore");
+		timeline.create(device);
 
-		ERROR("Failed to find suitable memory type!");
+		LOG("Synchronization objects created");
 	}
 
 	VkCommandBuffer beginSingleTimeCommands() {
@@ -1129,22 +1460,34 @@ class TouhouEngine {
 
 		LOG("Submitting command buffer");
 
-		const VkSubmitInfo submitInfo{
-			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		const uint64_t signalValue = timeline.next();
+		const VkTimelineSemaphoreSubmitInfoKHR timelineInfo{
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
 			.pNext = VK_NULL_HANDLE,
+			.waitSemaphoreValueCount = 0,
+			.pWaitSemaphoreValues = VK_NULL_HANDLE,
+			.signalSemaphoreValueCount = 1,
+			.pSignalSemaphoreValues = &signalValue,
+		};
+
+		const VkSubmitInfo submitInfo{
+			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+			.pNext = &timelineInfo,
 			.waitSemaphoreCount = 0,
 			.pWaitSemaphores = VK_NULL_HANDLE,
 			.pWaitDstStageMask = VK_NULL_HANDLE,
 			.commandBufferCount = 1,
 			.pCommandBuffers = &commandBuffer,
-			.signalSemaphoreCount = 0,
-			.pSignalSemaphores = VK_NULL_HANDLE,
+			.signalSemaphoreCount = 1,
+			.pSignalSemaphores = &timeline.semaphore,
 		};
 
 		vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE);
-		vkQueueWaitIdle(graphicsQueue);
 
-		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
+		// Frames wait on this value before using anything uploaded here
+		uploadTimelineValue = signalValue;
+		deletionQueue.push(signalValue,
+						   [this, commandBuffer] { vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer); });
 	}
 
 	void copyBuffer(const VkBuffer srcBuffer, const VkBuffer dstBuffer, const VkDeviceSize size) {
@@ -1161,7 +1504,7 @@ class TouhouEngine {
 	}
 
 	void createBuffer(const VkDeviceSize size, const VkBufferUsageFlags usage, const VkMemoryPropertyFlags properties,
-					  VkBuffer &buffer, VkDeviceMemory &bufferMemory) {
+					  VkBuffer &buffer, VkDeviceMemory &bufferMemory, const MemoryCategory category) {
 		LOG("Creating single vertex buffer");
 		const VkBufferCreateInfo bufferInfo{
 			.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO,
@@ -1180,16 +1523,8 @@ class TouhouEngine {
 		VkMemoryRequirements memRequirements;
 		vkGetBufferMemoryRequirements(device, buffer, &memRequirements);
 
-		const VkMemoryAllocateInfo allocInfo{
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.allocationSize = memRequirements.size,
-			.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, properties),
-		};
-
 		LOG("Allocating vertex buffer memory");
-		VK_CHECK(vkAllocateMemory(device, &allocInfo, VK_NULL_HANDLE, &bufferMemory),
-				 "Failed to allocate vertex buffer memory!");
+		bufferMemory = memory.allocate(memRequirements, properties, category);
 
 		LOG("Binding vertex buffer memory");
 		vkBindBufferMemory(device, buffer, bufferMemory, 0);
@@ -1200,7 +1535,7 @@ class TouhouEngine {
 		LOG("Creating staging buffer");
 		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, stagingBuffer,
-					 stagingBufferMemory);
+					 stagingBufferMemory, MemoryCategory::Staging);
 
 		LOG("Mapping staging buffer");
 		void *data;
@@ -1211,7 +1546,21 @@ class TouhouEngine {
 
 	void clearMappedBuffer(const VkBuffer buffer, const VkDeviceMemory bufferMemory) {
 		vkDestroyBuffer(device, buffer, VK_NULL_HANDLE);
-		vkFreeMemory(device, bufferMemory, VK_NULL_HANDLE);
+		memory.free(bufferMemory);
+	}
+
+	// Destroys the buffer once every submission so far, which may still use it, has completed
+	void retireBuffer(const VkBuffer buffer, const VkDeviceMemory bufferMemory) {
+		deletionQueue.push(timeline.lastSubmitted(),
+						   [this, buffer, bufferMemory] { clearMappedBuffer(buffer, bufferMemory); });
+	}
+
+	void retireImage(const VkImage image, const VkDeviceMemory imageMemory, const VkImageView imageView) {
+		deletionQueue.push(timeline.lastSubmitted(), [this, image, imageMemory, imageView] {
+			releaseImageView(imageView);
+			vkDestroyImage(device, image, VK_NULL_HANDLE);
+			memory.free(imageMemory);
+		});
 	}
 
 	void createAndAllocBuffer(const VkDeviceSize bufferSize, const VkBufferUsageFlags usage, const void *bufferData,
@@ -1224,13 +1573,13 @@ class TouhouEngine {
 
 		LOG("Creating main buffer");
 		createBuffer(bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | usage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, buffer,
-					 bufferMemory);
+					 bufferMemory, MemoryCategory::Buffers);
 
 		LOG("Copying buffer");
 		copyBuffer(stagingBuffer, buffer, bufferSize);
 
-		LOG("Destroying staging buffer");
-		clearMappedBuffer(stagingBuffer, stagingBufferMemory);
+		LOG("Retiring staging buffer");
+		retireBuffer(stagingBuffer, stagingBufferMemory);
 	}
 
 	void createVertexBuffer() {
@@ -1276,8 +1625,7 @@ class TouhouEngine {
 			.pBindings = bindings.data(),
 		};
 
-		VK_CHECK(vkCreateDescriptorSetLayout(device, &layoutInfo, VK_NULL_HANDLE, &descriptorSetLayout),
-				 "Failed to create descriptor set layout!");
+		descriptorSetLayout = acquireDescriptorSetLayout(layoutInfo);
 
 		LOG("Descriptor set layout created");
 	}
@@ -1293,7 +1641,7 @@ class TouhouEngine {
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
 			createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, uniformBuffers[i],
-						 uniformBuffersMemory[i]);
+						 uniformBuffersMemory[i], MemoryCategory::Buffers);
 
 			vkMapMemory(device, uniformBuffersMemory[i], 0, bufferSize, 0, &uniformBuffersMapped[i]);
 		}
@@ -1301,214 +1649,355 @@ class TouhouEngine {
 		LOG("Uniform buffers created");
 	}
 
-	void createDescriptorPool() {
-		LOG("Creating descriptor pool");
-
-		const std::array<VkDescriptorPoolSize, 2> poolSizes = {
-			VkDescriptorPoolSize{
-				.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-				.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
-			},
-			VkDescriptorPoolSize{
-				.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.descriptorCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
-			},
-		};
-
-		const VkDescriptorPoolCreateInfo poolInfo{
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.flags = 0,
-			.maxSets = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
-			.poolSizeCount = SIZE(poolSizes),
-			.pPoolSizes = poolSizes.data(),
-		};
-
-		VK_CHECK(vkCreateDescriptorPool(device, &poolInfo, VK_NULL_HANDLE, &descriptorPool),
-				 "Failed to create descriptor pool!");
-	}
-
-	void createDescriptorSets() {
-		LOG("Creating descriptor sets");
+	void createDescriptorAllocators() {
+		LOG("Creating descriptor allocators");
 
-		const list<VkDescriptorSetLayout> layouts(MAX_FRAMES_IN_FLIGHT, descriptorSetLayout);
-		const VkDescriptorSetAllocateInfo allocInfo{
-			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.descriptorPool = descriptorPool,
-			.descriptorSetCount = static_cast<uint32_t>(MAX_FRAMES_IN_FLIGHT),
-			.pSetLayouts = layouts.data(),
+		const std::array<VkDescriptorPoolSize, 2> descriptorsPerSet = {
+			VkDescriptorPoolSize{.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, .descriptorCount = 1},
+			VkDescriptorPoolSize{.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, .descriptorCount = 1},
 		};
-		descriptorSets.resize(MAX_FRAMES_IN_FLIGHT);
-
-		VK_CHECK(vkAllocateDescriptorSets(device, &allocInfo, descriptorSets.data()),
-				 "Failed to allocate descriptor sets!");
-
-		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
-			const VkDescriptorBufferInfo bufferInfo{
-				.buffer = uniformBuffers[i],
-				.offset = 0,
-				.range = sizeof(UniformBufferObject),
-			};
-
-			const VkDescriptorImageInfo imageInfo{
-				.sampler = textureSampler,
-				.imageView = textureImageView,
-				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-			};
-
-			const std::array<VkWriteDescriptorSet, 2> descriptorWrites = {
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.pNext = VK_NULL_HANDLE,
-					.dstSet = descriptorSets[i],
-					.dstBinding = 0,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-					.pImageInfo = VK_NULL_HANDLE,
-					.pBufferInfo = &bufferInfo,
-					.pTexelBufferView = VK_NULL_HANDLE,
-				},
-				VkWriteDescriptorSet{
-					.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-					.pNext = VK_NULL_HANDLE,
-					.dstSet = descriptorSets[i],
-					.dstBinding = 1,
-					.dstArrayElement = 0,
-					.descriptorCount = 1,
-					.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-					.pImageInfo = &imageInfo,
-					.pBufferInfo = VK_NULL_HANDLE,
-					.pTexelBufferView = VK_NULL_HANDLE,
-				},
-			};
-
-			vkUpdateDescriptorSets(device, SIZE(descriptorWrites), descriptorWrites.data(), 0, VK_NULL_HANDLE);
+		for (DescriptorAllocator &allocator : frameDescriptors) {
+			allocator.create(device, descriptorsPerSet);
 		}
 	}
 
-	void transitionImageLayout(const VkImage image, const VkImageLayout oldLayout, const VkImageLayout newLayout) {
-		const VkCommandBuffer commandBuffer = beginSingleTimeCommands();
-
-		const VkImageMemoryBarrier barrier{
-			.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
-			.pNext = VK_NULL_HANDLE,
-			.srcAccessMask = 0,
-			.dstAccessMask = 0,
-			.oldLayout = oldLayout,
-			.newLayout = newLayout,
-			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
-			.image = image,
-			.subresourceRange =
+	// The uniform buffer of the current frame and imageView, for the draws of this frame only
+	VkDescriptorSet getTextureDescriptorSet(const VkImageView imageView) {
+		return frameDescriptorSets.get(DescriptorSetKey{
+			.layout = descriptorSetLayout,
+			.bindings =
 				{
-					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.baseMipLevel = 0,
-					.levelCount = 1,
-					.baseArrayLayer = 0,
-					.layerCount = 1,
+					DescriptorBinding{
+						.binding = 0,
+						.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
+						.buffer = uniformBuffers[currentFrame],
+						.offset = 0,
+						.range = sizeof(UniformBufferObject),
+						.sampler = VK_NULL_HANDLE,
+						.imageView = VK_NULL_HANDLE,
+						.imageLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+					},
+					DescriptorBinding{
+						.binding = 1,
+						.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+						.buffer = VK_NULL_HANDLE,
+						.offset = 0,
+						.range = 0,
+						.sampler = textureSampler,
+						.imageView = imageView,
+						.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+					},
 				},
-		};
-
-		vkCmdPipelineBarrier(commandBuffer, 0, 0, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &barrier);
-
-		endSingleTimeCommands(commandBuffer);
+		});
 	}
 
-	void copyBufferToImage(const VkBuffer buffer, const VkImage image, const uint32_t width, const uint32_t height) {
-		const VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+	void transitionImageLayout(const VkCommandBuffer commandBuffer, const VkImage image, const UsageState &from,
+							   const UsageState &to, const uint32_t mipLevels = 1) {
+		const VkImageMemoryBarrier barrier = getImageBarrier(image, from, to, mipLevels);
+		vkCmdPipelineBarrier(commandBuffer, from.stage, to.stage, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, 1, &barrier);
+	}
 
-		const VkBufferImageCopy region{
-			.bufferOffset = 0,
+	static VkBufferImageCopy getImageCopyRegion(const VkDeviceSize bufferOffset, const uint32_t mipLevel,
+												const uint32_t width, const uint32_t height) {
+		return VkBufferImageCopy{
+			.bufferOffset = bufferOffset,
 			.bufferRowLength = 0,
 			.bufferImageHeight = 0,
 			.imageSubresource =
 				{
 					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
-					.mipLevel = 0,
+					.mipLevel = mipLevel,
 					.baseArrayLayer = 0,
 					.layerCount = 1,
 				},
 			.imageOffset = {0, 0, 0},
-			.imageExtent = {width, height, 1},
+			.imageExtent = {std::max(width >> mipLevel, 1u), std::max(height >> mipLevel, 1u), 1},
 		};
+	}
 
+	void copyBufferToImage(const VkCommandBuffer commandBuffer, const VkBuffer buffer, const VkDeviceSize bufferOffset,
+						   const VkImage image, const uint32_t width, const uint32_t height) {
+		const VkBufferImageCopy region = getImageCopyRegion(bufferOffset, 0, width, height);
 		vkCmdCopyBufferToImage(commandBuffer, buffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
-
-		endSingleTimeCommands(commandBuffer);
 	}
 
-	void createTextureImage() {
-		LOG("Creating texture image");
-
-		int texWidth, texHeight, texChannels;
-		stbi_uc *pixels = stbi_load("textures/texture.jpg", &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
-		const VkDeviceSize imageSize = texWidth * texHeight * 4; // 4 bytes per pixel
-
-		VALIDATE(pixels, "Failed to load texture image!");
-
-		VkBuffer stagingBuffer;
-		VkDeviceMemory stagingBufferMemory;
-		createStagingBuffer(stagingBuffer, stagingBufferMemory, pixels, imageSize);
-
-		stbi_image_free(pixels);
-
+	void createImage(const ImageDesc &desc, VkImage &image, VkDeviceMemory &imageMemory,
+					 const MemoryCategory category) {
+		LOG("Creating image");
 		const VkImageCreateInfo imageInfo = {
 			.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 			.pNext = VK_NULL_HANDLE,
 			.flags = 0,
 			.imageType = VK_IMAGE_TYPE_2D,
-			.format = VK_FORMAT_R8G8B8A8_SRGB,
-			.extent = {static_cast<uint32_t>(texWidth), static_cast<uint32_t>(texHeight), 1},
-			.mipLevels = 1,
+			.format = desc.format,
+			.extent = {desc.extent.width, desc.extent.height, 1},
+			.mipLevels = desc.mipLevels,
 			.arrayLayers = 1,
 			.samples = VK_SAMPLE_COUNT_1_BIT,
 			.tiling = VK_IMAGE_TILING_OPTIMAL,
-			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.usage = desc.usage,
 			.sharingMode = VK_SHARING_MODE_EXCLUSIVE,
 			.queueFamilyIndexCount = 0,
 			.pQueueFamilyIndices = VK_NULL_HANDLE,
 			.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
 		};
 
-		VK_CHECK(vkCreateImage(device, &imageInfo, VK_NULL_HANDLE, &textureImage), "Failed to create texture image!");
+		VK_CHECK(vkCreateImage(device, &imageInfo, VK_NULL_HANDLE, &image), "Failed to create image!");
 
 		VkMemoryRequirements memRequirements;
-		vkGetImageMemoryRequirements(device, textureImage, &memRequirements);
+		vkGetImageMemoryRequirements(device, image, &memRequirements);
 
-		const VkMemoryAllocateInfo allocInfo = {
-			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.allocationSize = memRequirements.size,
-			.memoryTypeIndex = findMemoryType(memRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT),
+		imageMemory = memory.allocate(memRequirements, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, category);
+
+		vkBindImageMemory(device, image, imageMemory, 0);
+	}
+
+	void openArchive() {
+		if (!archive.open(ARCHIVE_PATH)) LOG("No archive at " << ARCHIVE_PATH << ", loading loose files");
+	}
+
+	// Mapped straight from the archive when the asset is packed, otherwise read from the loose file into storage
+	std::span<const uint8_t> readAsset(const std::string &path, list<char> &storage) {
+		if (const auto asset = archive.find(path)) return asset->data;
+
+		storage = readFile(path);
+		return {reinterpret_cast<const uint8_t *>(storage.data()), storage.size()};
+	}
+
+	void createReadbackRing() {
+		LOG("Creating readback ring");
+		const VkDeviceSize slotSize = ReadbackRing::getSlotSize({WIDTH, HEIGHT});
+
+		VkBuffer buffer;
+		createBuffer(slotSize * READBACK_SLOTS, VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer, readbackMemory,
+					 MemoryCategory::Staging);
+
+		void *mapped;
+		vkMapMemory(device, readbackMemory, 0, slotSize * READBACK_SLOTS, 0, &mapped);
+		readback.create(buffer, mapped, slotSize, READBACK_SLOTS);
+	}
+
+	void createAssetLoader() {
+		LOG("Creating staging ring");
+		VkBuffer buffer;
+		createBuffer(STAGING_RING_SIZE, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+					 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, buffer,
+					 stagingRingMemory, MemoryCategory::Staging);
+
+		void *mapped;
+		vkMapMemory(device, stagingRingMemory, 0, STAGING_RING_SIZE, 0, &mapped);
+		stagingRing.create(buffer, mapped, STAGING_RING_SIZE);
+
+		assetLoader.create(jobs, stagingRing);
+	}
+
+	// Sampled until the loader publishes the requested texture
+	void createTextureImage() { textureDesc = createPlaceholderTexture(textureImage, textureImageMemory); }
+
+	// 1x1 white
+	ImageDesc createPlaceholderTexture(VkImage &image, VkDeviceMemory &imageMemory) {
+		LOG("Creating placeholder texture image");
+		const uint32_t white = 0xFFFFFFFF;
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		createStagingBuffer(stagingBuffer, stagingBufferMemory, &white, sizeof(white));
+		const ImageDesc desc = createTextureFromStaging(stagingBuffer, 0, 1, 1, image, imageMemory);
+		retireBuffer(stagingBuffer, stagingBufferMemory);
+		return desc;
+	}
+
+	// Streamed textures give way when the device local heaps go over budget: the largest mip levels are dropped
+	// first, and the texture is evicted for the placeholder once there is nothing left to drop. Usage has to fall
+	// under the low watermark before anything comes back, so the texture does not bounce around the limit
+	void applyMemoryPolicy() {
+		memory.updateBudget();
+		const double pressure = memory.getDeviceLocalPressure();
+
+		if (pressure > 1.0 && !textureEvicted) {
+			if (textureDesc.mipLevels > 1) {
+				LOG("Over memory budget (" << pressure << "), dropping the top mip level of the texture");
+				++textureMipBias;
+				requestTexture(TEXTURE_PATH);
+			} else {
+				LOG("Over memory budget (" << pressure << "), evicting the texture");
+				VkImage image;
+				VkDeviceMemory imageMemory;
+				const ImageDesc desc = createPlaceholderTexture(image, imageMemory);
+				swapTexture(image, imageMemory, desc);
+				textureEvicted = true;
+			}
+		} else if (pressure < MEMORY_LOW_WATERMARK && (textureEvicted || textureMipBias > 0)) {
+			LOG("Back under the memory watermark (" << pressure << "), restoring the texture");
+			if (textureEvicted) {
+				textureEvicted = false;
+			} else {
+				--textureMipBias;
+			}
+			requestTexture(TEXTURE_PATH);
+		}
+	}
+
+	void printMemoryStats() {
+		memory.updateBudget();
+		std::cout << "memory ";
+		MemoryTracker::writeStats(std::cout, memory.getStats());
+		std::cout << std::endl;
+		std::cout << "cached " << samplerCache.size() << " samplers, " << imageViewCache.size() << " image views, "
+				  << descriptorSetLayoutCache.size() << " descriptor set layouts" << std::endl;
+	}
+
+	void requestTexture(const char *path) {
+		const bool isPacked = archive.find(path).has_value();
+		if (!isPacked && !std::string_view(path).ends_with(".ktx2")) {
+			LOG("Queueing texture " << path << " for decoding");
+			assetLoader.loadImage(path);
+			return;
+		}
+
+		// Packed textures are KTX2 already in their upload format, they need no decoding, only a copy
+		LOG("Creating texture image from " << path << (isPacked ? " (archive)" : ""));
+		list<char> storage;
+		const std::span<const uint8_t> file = readAsset(path, storage);
+
+		VkImage image;
+		VkDeviceMemory imageMemory;
+		const ImageDesc desc =
+			loadKtx2TextureImage(parseKtx2(file.data(), file.size()), image, imageMemory, textureMipBias);
+		swapTexture(image, imageMemory, desc);
+	}
+
+	// Called at the start of a frame with every image the workers finished decoding since the previous one
+	void uploadLoadedImage(const LoadedImage &loaded) {
+		if (!loaded.error.empty()) {
+			LOGE(loaded.error);
+			if (loaded.staging) stagingRing.retire(*loaded.staging, 0);
+			return;
+		}
+
+		LOG("Uploading " << loaded.path << " from staging offset " << loaded.staging->offset);
+		VkImage image;
+		VkDeviceMemory imageMemory;
+		const ImageDesc desc = createTextureFromStaging(stagingRing.buffer, loaded.staging->offset, loaded.width,
+														loaded.height, image, imageMemory);
+		stagingRing.retire(*loaded.staging, timeline.lastSubmitted());
+		swapTexture(image, imageMemory, desc);
+	}
+
+	bool isFormatSampleable(const VkFormat format) {
+		VkFormatProperties properties;
+		vkGetPhysicalDeviceFormatProperties(physicalDevice, format, &properties);
+		return properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	}
+
+	ImageDesc createTextureFromStaging(const VkBuffer stagingBuffer, const VkDeviceSize offset, const uint32_t width,
+									   const uint32_t height, VkImage &image, VkDeviceMemory &imageMemory) {
+		const ImageDesc desc{
+			.format = VK_FORMAT_R8G8B8A8_SRGB,
+			.extent = {width, height},
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 		};
+		createImage(desc, image, imageMemory, MemoryCategory::Textures);
 
-		VK_CHECK(vkAllocateMemory(device, &allocInfo, VK_NULL_HANDLE, &textureImageMemory),
-				 "Failed to allocate texture image memory!");
+		// Both transitions and the copy go in a single submit
+		const VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		const UsageState undefined{VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+		transitionImageLayout(commandBuffer, image, undefined, getUsageState(ResourceUsage::TransferDst));
+		copyBufferToImage(commandBuffer, stagingBuffer, offset, image, width, height);
+		transitionImageLayout(commandBuffer, image, getUsageState(ResourceUsage::TransferDst),
+							  getUsageState(ResourceUsage::Sampled));
+		endSingleTimeCommands(commandBuffer);
 
-		vkBindImageMemory(device, textureImage, textureImageMemory, 0);
+		return desc;
+	}
+
+	// Block compressed levels (BC7, ETC2, ASTC...) are copied as is when the device can sample the format, which
+	// keeps them compressed in VRAM. Otherwise BC1-3 are decoded to RGBA8 on the CPU
+	// The first skipLevels levels are left out to save memory, the smallest level is always kept
+	ImageDesc loadKtx2TextureImage(const Ktx2Texture &ktx, VkImage &image, VkDeviceMemory &imageMemory,
+								   const uint32_t skipLevels = 0) {
+		const uint32_t baseLevel = std::min(skipLevels, static_cast<uint32_t>(ktx.levels.size()) - 1);
+		const uint32_t mipLevels = static_cast<uint32_t>(ktx.levels.size()) - baseLevel;
+		const uint32_t width = std::max(ktx.width >> baseLevel, 1u), height = std::max(ktx.height >> baseLevel, 1u);
+
+		ImageDesc desc{
+			.format = ktx.format,
+			.extent = {width, height},
+			.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
+			.mipLevels = mipLevels,
+		};
+		list<VkBufferImageCopy> regions;
+
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		if (isFormatSampleable(ktx.format)) {
+			LOG("Uploading " << mipLevels << " compressed levels of format " << ktx.format);
+			// The whole file is staged so the level offsets can be used directly
+			createStagingBuffer(stagingBuffer, stagingBufferMemory, ktx.data, ktx.size);
+			for (uint32_t level = 0; level < mipLevels; ++level) {
+				regions.push_back(getImageCopyRegion(ktx.levels[baseLevel + level].byteOffset, level, width, height));
+			}
+		} else {
+			VALIDATE(isCpuDecodable(ktx.format),
+					 "Texture format " + std::to_string(ktx.format) + " is not supported by the device!");
+			LOG("Format " << ktx.format << " is not supported by the device, decoding on the CPU");
+
+			desc.format = getCpuDecodedFormat(ktx.format);
+			list<uint8_t> pixels;
+			for (uint32_t level = 0; level < mipLevels; ++level) {
+				const Ktx2Level &source = ktx.levels[baseLevel + level];
+				const list<uint8_t> decoded = decodeBlockCompressed(ktx.format, ktx.data + source.byteOffset,
+																	std::max(width >> level, 1u),
+																	std::max(height >> level, 1u));
+
+				regions.push_back(getImageCopyRegion(pixels.size(), level, width, height));
+				pixels.insert(pixels.end(), decoded.begin(), decoded.end());
+			}
+			createStagingBuffer(stagingBuffer, stagingBufferMemory, pixels.data(), pixels.size());
+		}
+
+		createImage(desc, image, imageMemory, MemoryCategory::Textures);
 
-		transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
-		copyBufferToImage(stagingBuffer, textureImage, static_cast<uint32_t>(texWidth),
-						  static_cast<uint32_t>(texHeight));
-		transitionImageLayout(textureImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-							  VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		const VkCommandBuffer commandBuffer = beginSingleTimeCommands();
+		const UsageState undefined{VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+		transitionImageLayout(commandBuffer, image, undefined, getUsageState(ResourceUsage::TransferDst), mipLevels);
+		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+							   static_cast<uint32_t>(regions.size()), regions.data());
+		transitionImageLayout(commandBuffer, image, getUsageState(ResourceUsage::TransferDst),
+							  getUsageState(ResourceUsage::Sampled), mipLevels);
+		endSingleTimeCommands(commandBuffer);
 
-		clearMappedBuffer(stagingBuffer, stagingBufferMemory);
+		retireBuffer(stagingBuffer, stagingBufferMemory);
+		return desc;
+	}
+
+	// Swaps the texture without stalling: frames already submitted keep the old one until they complete, the next frame
+	// gets a descriptor set for the new one
+	void swapTexture(const VkImage image, const VkDeviceMemory imageMemory, const ImageDesc &desc) {
+		retireImage(textureImage, textureImageMemory, textureImageView);
+
+		textureImage = image;
+		textureImageMemory = imageMemory;
+		textureDesc = desc;
+		createTextureImageView();
+	}
+
+	void reloadTexture() {
+		LOG("Reloading texture");
+		requestTexture(TEXTURE_PATH);
 	}
 
 	void createTextureImageView() {
 		LOG("Creating texture image view");
-		textureImageView = createImageView(textureImage, VK_FORMAT_R8G8B8A8_SRGB);
+		textureImageView = createImageView(textureImage, textureDesc.format, textureDesc.mipLevels);
 		LOG("Texture image view created");
 	}
 
 	void createTextureSampler() {
 		LOG("Creating texture sampler");
 
-		VkPhysicalDeviceProperties properties;
-		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+		const VkPhysicalDeviceProperties &properties = capabilities.properties;
 
 		// TODO: Have fun changing this !!
 		const VkSamplerCreateInfo samplerInfo = {
@@ -1527,55 +2016,94 @@ class TouhouEngine {
 			.compareEnable = VK_FALSE,
 			.compareOp = VK_COMPARE_OP_ALWAYS,
 			.minLod = 0.0f,
-			.maxLod = 0.0f,
+			.maxLod = VK_LOD_CLAMP_NONE,
 			.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK,
 			.unnormalizedCoordinates = VK_FALSE,
 		};
 
-		VK_CHECK(vkCreateSampler(device, &samplerInfo, VK_NULL_HANDLE, &textureSampler),
-				 "Failed to create texture sampler!");
+		textureSampler = acquireSampler(samplerInfo);
 		LOG("Texture sampler created");
 	}
 
+	// Steps only creating objects from the device run on workers, pipeline compilation overlaps with everything
+	// recorded or submitted on the main thread
 	void initVulkan() {
-		createVkInstance();
-		setupDebugMessenger();
-
-		createWindowSurface();
-		pickPhysicalDevice();
-		createLogicalDevice();
-
-		createSwapChain();
-		createImageViews();
-
-		createRenderPass();
-		createDescriptorSetLayout();
-
-		createGraphicsPipeline();
-		createFramebuffers();
-
-		createCommandPool();
-		createCommandBuffers();
-
-		createTextureImage();
-		createTextureImageView();
-		createTextureSampler();
-
-		createVertexBuffer();
-		createIndexBuffer();
+		jobs.start();
+
+		constexpr auto Worker = InitGraph::Thread::Worker;
+		InitGraph init;
+
+		const auto archiveStep = init.add("openArchive", {}, [this] { openArchive(); });
+
+		const auto instanceStep = init.add("createVkInstance", {}, [this] { createVkInstance(); });
+		init.add("setupDebugMessenger", {instanceStep}, [this] { setupDebugMessenger(); });
+
+		const auto surfaceStep = init.add("createWindowSurface", {instanceStep}, [this] { createWindowSurface(); });
+		const auto physicalDeviceStep =
+			init.add("pickPhysicalDevice", {surfaceStep}, [this] { pickPhysicalDevice(); });
+		const auto logicalDeviceStep =
+			init.add("createLogicalDevice", {physicalDeviceStep}, [this] { createLogicalDevice(); });
+
+		const auto swapChainStep = init.add("createSwapChain", {logicalDeviceStep}, [this] { createSwapChain(); });
+		const auto imageViewsStep = init.add("createImageViews", {swapChainStep}, [this] { createImageViews(); });
+
+		const auto renderPassStep = init.add("createRenderPass", {swapChainStep}, [this] { createRenderPass(); });
+		const auto descriptorSetLayoutStep =
+			init.add("createDescriptorSetLayout", {logicalDeviceStep}, [this] { createDescriptorSetLayout(); });
+
+		const auto shaderModulesStep =
+			init.add("createShaderModules", {logicalDeviceStep}, [this] { createShaderModules(); }, Worker);
+		const auto pipelineLayoutStep = init.add(
+			"createPipelineLayout", {descriptorSetLayoutStep}, [this] { createPipelineLayout(); }, Worker);
+		const auto blendPipelinesStep =
+			init.add("createBlendPipelines", {renderPassStep, pipelineLayoutStep, shaderModulesStep},
+					 [this] { createBlendPipelines(); }, Worker);
+		init.add("createFramebuffers", {imageViewsStep, renderPassStep}, [this] { createFramebuffers(); });
+		init.add("createFrameGraph", {swapChainStep}, [this] { createFrameGraph(); });
+
+		const auto commandPoolStep =
+			init.add("createCommandPool", {logicalDeviceStep}, [this] { createCommandPool(); });
+		init.add("createCommandBuffers", {commandPoolStep}, [this] { createCommandBuffers(); });
+		const auto syncObjectsStep =
+			init.add("createSyncObjects", {logicalDeviceStep}, [this] { createSyncObjects(); });
+
+		const auto assetLoaderStep =
+			init.add("createAssetLoader", {logicalDeviceStep}, [this] { createAssetLoader(); });
+		const auto textureImageStep =
+			init.add("createTextureImage", {commandPoolStep, syncObjectsStep}, [this] { createTextureImage(); });
+		const auto textureImageViewStep =
+			init.add("createTextureImageView", {textureImageStep}, [this] { createTextureImageView(); });
+		init.add("createTextureSampler", {logicalDeviceStep}, [this] { createTextureSampler(); }, Worker);
+
+		const auto vertexBufferStep =
+			init.add("createVertexBuffer", {commandPoolStep, syncObjectsStep}, [this] { createVertexBuffer(); });
+		init.add("createIndexBuffer", {vertexBufferStep}, [this] { createIndexBuffer(); });
+
+		init.add("createUniformBuffers", {logicalDeviceStep}, [this] { createUniformBuffers(); });
+		init.add("createDescriptorAllocators", {logicalDeviceStep}, [this] { createDescriptorAllocators(); });
+
+		init.add("requestTexture", {archiveStep, assetLoaderStep, textureImageViewStep},
+				 [this] { requestTexture(TEXTURE_PATH); });
+		if (enableShaderHotReload) {
+			init.add("startShaderWatcher", {blendPipelinesStep}, [this] { startShaderWatcher(); });
+		}
+		if (captureEnabled) {
+			init.add("createReadbackRing", {logicalDeviceStep}, [this] { createReadbackRing(); });
+		}
 
-		createUniformBuffers();
-		createDescriptorPool();
-		createDescriptorSets();
+		init.run(jobs);
 
-		createSyncObjects();
+		LOG("Initialization steps:");
+		init.logTimings();
+		LOG("Initialized " << millisecondsSince(processStart) << " ms after process start");
 	}
 
 	void updateUniformBuffer(const uint32_t currentFrame) {
 		static auto startTime = std::chrono::high_resolution_clock::now();
 
 		const auto currentTime = std::chrono::high_resolution_clock::now();
-		const float time = std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count();
+		const float time = fixedTime.value_or(
+			std::chrono::duration<float, std::chrono::seconds::period>(currentTime - startTime).count());
 
 		UniformBufferObject ubo{
 			.model = glm::rotate(glm::mat4(1.0f), time * glm::radians(90.0f), glm::vec3(0.0f, 0.0f, 1.0f)),
@@ -1589,7 +2117,23 @@ class TouhouEngine {
 	}
 
 	void drawNextFrame() {
-		vkWaitForFences(device, 1, &waitFrameFences[currentFrame], VK_TRUE, UINT64_MAX);
+		isDrawing = true;
+		drawFrame();
+		isDrawing = false;
+	}
+
+	void drawFrame() {
+		timeline.wait(frameTimelineValues[currentFrame]);
+		// The cache is reset first, its previous map still lives in the arena
+		frameDescriptors[currentFrame].reset();
+		frameDescriptorSets.reset(device, frameDescriptors[currentFrame], &frameArena);
+		frameArena.reset();
+		deletionQueue.collect(timeline.completed());
+		stagingRing.collect(timeline.completed());
+		readback.collect(timeline.completed(), [this](const ReadbackFrame &frame) { return onFrameCaptured(frame); });
+		assetLoader.poll([this](const LoadedImage &image) { uploadLoadedImage(image); });
+		if (enableShaderHotReload) updateShaders();
+		if (frameCount++ % MEMORY_POLICY_INTERVAL == 0) applyMemoryPolicy();
 
 		updateUniformBuffer(currentFrame);
 
@@ -1604,27 +2148,54 @@ class TouhouEngine {
 			ERROR("Failed to acquire next image for frame!");
 		}
 
-		vkResetFences(device, 1, &waitFrameFences[currentFrame]);
+		const auto recordStart = std::chrono::steady_clock::now();
+		queueDraws();
 
 		vkResetCommandBuffer(commandBuffers[currentFrame], 0);
 		recordCommandBuffer(commandBuffers[currentFrame], imageIndex);
+		recordMilliseconds = millisecondsSince(recordStart);
+
+		// Uploads are not waited on by the CPU, the frame waits on the GPU for the last one instead
+		const VkSemaphore waitSemaphores[] = {imageAvailableSemaphores[currentFrame], timeline.semaphore};
+		const VkPipelineStageFlags waitStagesMask[] = {
+			VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT |
+				VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		};
 
-		const VkPipelineStageFlags waitStagesMask[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+		// Binary semaphores ignore their value
+		const uint64_t waitValues[] = {0, uploadTimelineValue};
+		const uint64_t signalValue = timeline.next();
+		const VkSemaphore signalSemaphores[] = {renderFinishedSemaphores[currentFrame], timeline.semaphore};
+		const uint64_t signalValues[] = {0, signalValue};
+
+		const VkTimelineSemaphoreSubmitInfoKHR timelineInfo{
+			.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.waitSemaphoreValueCount = 2,
+			.pWaitSemaphoreValues = waitValues,
+			.signalSemaphoreValueCount = 2,
+			.pSignalSemaphoreValues = signalValues,
+		};
 
 		const VkSubmitInfo submitInfo{
 			.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-			.pNext = VK_NULL_HANDLE,
-			.waitSemaphoreCount = 1,
-			.pWaitSemaphores = &imageAvailableSemaphores[currentFrame],
+			.pNext = &timelineInfo,
+			.waitSemaphoreCount = 2,
+			.pWaitSemaphores = waitSemaphores,
 			.pWaitDstStageMask = waitStagesMask,
 			.commandBufferCount = 1,
 			.pCommandBuffers = &commandBuffers[currentFrame],
-			.signalSemaphoreCount = 1,
-			.pSignalSemaphores = &renderFinishedSemaphores[currentFrame],
+			.signalSemaphoreCount = 2,
+			.pSignalSemaphores = signalSemaphores,
 		};
 
-		VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, waitFrameFences[currentFrame]),
-				 "Failed to submit draw command buffer!");
+		VK_CHECK(vkQueueSubmit(graphicsQueue, 1, &submitInfo, VK_NULL_HANDLE), "Failed to submit draw command buffer!");
+		frameTimelineValues[currentFrame] = signalValue;
+		if (captureSlot) {
+			readback.submit(*captureSlot, signalValue);
+			captureSlot.reset();
+		}
 
 		VkPresentInfoKHR presentInfo{
 			.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR,
@@ -1639,30 +2210,45 @@ class TouhouEngine {
 
 		result = vkQueuePresentKHR(presentQueue, &presentInfo);
 
+		if (!firstFramePresented) {
+			firstFramePresented = true;
+			LOG("First frame presented " << millisecondsSince(processStart) << " ms after process start");
+		}
+
+		// The frame was submitted either way, so its slot is done for now
+		++currentFrame %= MAX_FRAMES_IN_FLIGHT;
+
 		if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR || framebufferResized) {
 			framebufferResized = false;
 			recreateSwapChain();
-			return;
 		} else if (result != VK_SUCCESS) {
 			ERROR("Failed to present swap chain image!");
 		}
-
-		++currentFrame %= MAX_FRAMES_IN_FLIGHT;
 	}
 
 	void recreateSwapChain() {
 		int width = 0, height = 0;
-		glfwGetFramebufferSize(window, &width, &height);
+		getFramebufferSize(width, height);
 		if (width == 0 || height == 0) {
-			glfwGetFramebufferSize(window, &width, &height);
+			getFramebufferSize(width, height);
 			LOG("Paused!");
 			glfwWaitEvents();
 			LOG("Unpaused!");
 		}
 
-		vkDeviceWaitIdle(device);
-
-		cleanupSwapchain();
+		// Frames already submitted keep using the old image views and framebuffers, they go once those complete
+		deletionQueue.push(timeline.lastSubmitted(), [this, oldSwapChain = swapChain,
+													  imageViews = std::move(swapChainImageViews),
+													  framebuffers = std::move(swapChainFramebuffer)] {
+			LOG("Destroying retired swap chain");
+			for (auto framebuffer : framebuffers) {
+				vkDestroyFramebuffer(device, framebuffer, VK_NULL_HANDLE);
+			}
+			for (auto imageView : imageViews) {
+				releaseImageView(imageView);
+			}
+			vkDestroySwapchainKHR(device, oldSwapChain, VK_NULL_HANDLE);
+		});
 
 		createSwapChain();
 		createImageViews();
@@ -1672,18 +2258,423 @@ class TouhouEngine {
 	void mainLoop() {
 		LOG("Running main loop");
 
-		do {
+		if (capturePath) startCapture();
+		if (recordPath) VALIDATE(inputRecorder.start(*recordPath), "Failed to open input recording: " + *recordPath);
+		if (replayPath) VALIDATE(inputReplay.load(*replayPath), "Failed to load input recording: " + *replayPath);
+		if (netplayPort) startNetplay();
+
+		list<double> frameTimes;
+		double tickAccumulator = 0.0;
+		auto previousFrameStart = std::chrono::steady_clock::now();
+
+		isRunning = true;
+		while (!quitRequested && !glfwWindowShouldClose(window)) {
 			glfwPollEvents();
+
+			const auto frameStart = std::chrono::steady_clock::now();
+			if (replayPath) {
+				const std::optional<InputState> input = inputReplay.next();
+				if (!input) break;
+				runTick(*input);
+			} else {
+				tickAccumulator += std::chrono::duration<double>(frameStart - previousFrameStart).count();
+				for (uint32_t ticks = 0; tickAccumulator >= TICK_TIME && ticks < MAX_TICKS_PER_FRAME; ++ticks) {
+					runTick(sampleInput());
+					tickAccumulator -= TICK_TIME;
+				}
+				tickAccumulator = std::min(tickAccumulator, TICK_TIME);
+			}
+			previousFrameStart = frameStart;
+
+			// Animations follow the simulation clock, ahead by the time not yet simulated when live
+			fixedTime = static_cast<float>(static_cast<double>(tickCount) * TICK_TIME + tickAccumulator);
+			if (videoEncoder.isRunning()) captureFrameId = frameCount;
+			drawNextFrame();
+			if (replayPath) frameTimes.push_back(millisecondsSince(frameStart));
+		}
+		isRunning = false;
+		fixedTime.reset();
+
+		vkDeviceWaitIdle(device);
+		if (videoEncoder.isRunning()) stopCapture();
+		if (recordPath) {
+			inputRecorder.stop();
+			std::cout << "Recorded " << inputRecorder.getTickCount() << " ticks to " << *recordPath
+					  << ", simulation checksum " << std::hex << simulation.getChecksum() << std::dec << std::endl;
+		}
+		if (replayPath) {
+			std::cout << "Replayed " << tickCount << " ticks, simulation checksum " << std::hex
+					  << simulation.getChecksum() << std::dec << ", frame time p50 " << getPercentile(frameTimes, 50.0)
+					  << " ms, p99 " << getPercentile(frameTimes, 99.0) << " ms" << std::endl;
+		}
+		if (netplay) {
+			std::cout << "Netplay ended at tick " << simulation.getTick() << ", " << netplay->getRollbackCount()
+					  << " rollbacks resimulating " << netplay->getResimulatedTicks() << " ticks, "
+					  << netplay->getStallCount() << " ticks stalled" << std::endl;
+		}
+	}
+
+	// The host is the first player and learns the address of the second from its first packet
+	void startNetplay() {
+		VALIDATE(udpTransport.open(netplayHost ? 0 : *netplayPort), "Failed to open UDP socket");
+		if (netplayHost) {
+			VALIDATE(udpTransport.connectTo(*netplayHost, *netplayPort), "Failed to resolve " + *netplayHost);
+		}
+		netplay.emplace(simulation, udpTransport, netplayHost ? 1 : 0);
+	}
+
+	// Held keys, and the ones tapped since the previous sample
+	InputState sampleInput() {
+		InputState input{.buttons = latchedButtons};
+		latchedButtons = 0;
+		for (const KeyBinding &binding : KEY_BINDINGS) {
+			if (glfwGetKey(window, binding.key) == GLFW_PRESS) input.buttons |= getButtonMask(binding.button);
+		}
+		return input;
+	}
+
+	// Everything reacting to input goes through here, so it happens at the same tick when replayed
+	void runTick(const InputState input) {
+		if (input.isHeld(Button::Quit)) quitRequested = true;
+		if (input.isPressed(Button::ReloadTexture, previousInput)) reloadTexture();
+		if (input.isPressed(Button::MemoryStats, previousInput)) printMemoryStats();
+		previousInput = input;
+
+		if (netplay) {
+			// Too far ahead of the other player, the tick is taken again later with newer input
+			if (!netplay->advance(input)) return;
+		} else {
+			simulation.step({input, InputState{}});
+		}
+
+		if (recordPath) inputRecorder.record(input);
+		++tickCount;
+	}
+
+	void startCapture() {
+		const bool y4m = capturePath->ends_with(".y4m");
+		if (!y4m) std::filesystem::create_directories(*capturePath);
+		VALIDATE(videoEncoder.start(*capturePath, y4m ? CaptureFormat::Y4m : CaptureFormat::PngSequence, readback),
+				 "Failed to open capture output: " + *capturePath);
+	}
+
+	// Device idle, the last captures are handed over and encoded before the readback ring goes away
+	void stopCapture() {
+		readback.collect(timeline.completed(), [this](const ReadbackFrame &frame) { return onFrameCaptured(frame); });
+		videoEncoder.stop();
+		std::cout << "Captured " << videoEncoder.getEncodedCount() << " frames to " << *capturePath << ", "
+				  << readback.getDroppedCount() + videoEncoder.getSkippedCount() << " dropped" << std::endl;
+	}
+
+	// Renders every scripted scene headless and writes the frame time, recording time and allocation percentiles of
+	// each to the report, so runs can be compared over time
+	void runBenchmark() {
+		LOG("Running benchmark on " << capabilities.properties.deviceName);
+
+		list<BenchResult> results;
+		for (const BenchScene &scene : BENCH_SCENES) {
+			loadBenchScene(scene);
+			for (uint32_t frame = 0; frame < BENCH_WARMUP_FRAMES; ++frame) {
+				drawNextFrame();
+			}
+
+			BenchResult &result = results.emplace_back(BenchResult{scene.name, {}});
+			result.samples.reserve(BENCH_FRAMES);
+			for (uint32_t frame = 0; frame < BENCH_FRAMES; ++frame) {
+				if (scene.resizeInterval != 0 && frame % scene.resizeInterval == 0) {
+					const bool small = frame / scene.resizeInterval % 2 == 0;
+					headlessExtent = small ? VkExtent2D{WIDTH / 2, HEIGHT / 2} : VkExtent2D{WIDTH, HEIGHT};
+					framebufferResized = true;
+				}
+
+				const uint64_t allocations = allocationCount.load(std::memory_order_relaxed);
+				const auto frameStart = std::chrono::steady_clock::now();
+				drawNextFrame();
+				result.samples.push_back(FrameSample{
+					.frameMilliseconds = millisecondsSince(frameStart),
+					.recordMilliseconds = recordMilliseconds,
+					.allocations = allocationCount.load(std::memory_order_relaxed) - allocations,
+				});
+			}
+
+			// Once warmed up, a frame without a resize has everything it needs already allocated
+			if (scene.resizeInterval == 0) {
+				uint64_t allocations = 0;
+				for (const FrameSample &sample : result.samples) {
+					allocations += sample.allocations;
+				}
+				if (allocations != 0) {
+					std::cerr << scene.name << ": " << allocations << " heap allocations in steady state frames"
+							  << std::endl;
+					benchFailed = true;
+				}
+			}
+		}
+		vkDeviceWaitIdle(device);
+		std::cout << "Frame arena peak " << frameArena.getPeak() << " bytes, " << frameArena.getOverflowCount()
+				  << " overflows" << std::endl;
+
+		list<SnapshotBenchResult> snapshots = measureSnapshots();
+		LoopbackBenchResult loopback = measureLoopbackSession();
+
+		std::ofstream report(*benchReportPath);
+		VALIDATE(report.is_open(), "Failed to open benchmark report: " + *benchReportPath);
+		writeBenchReport(report, capabilities.properties.deviceName, results, snapshots, loopback);
+		std::cout << "Benchmark report written to " << *benchReportPath << std::endl;
+	}
+
+	list<SnapshotBenchResult> measureSnapshots() {
+		list<SnapshotBenchResult> results;
+		for (const uint32_t bulletCount : SNAPSHOT_BENCH_BULLETS) {
+			Simulation state;
+			BenchRandom random(bulletCount);
+			while (state.getBullets().size() < bulletCount) {
+				const Angle angle = static_cast<Angle>(random.next() * 65536.0f);
+				state.getBullets().spawn({}, fromAngle(angle, Fixed::fromInt(1)));
+			}
+
+			SnapshotBenchResult &result = results.emplace_back(SnapshotBenchResult{bulletCount, 0, {}, {}});
+			list<uint8_t> snapshot(Simulation::MAX_SNAPSHOT_SIZE);
+			for (uint32_t i = 0; i < SNAPSHOT_BENCH_ITERATIONS; ++i) {
+				const auto saveStart = std::chrono::steady_clock::now();
+				result.snapshotSize = state.save(snapshot.data());
+				result.saveMilliseconds.push_back(millisecondsSince(saveStart));
+
+				const auto restoreStart = std::chrono::steady_clock::now();
+				state.restore(snapshot.data());
+				result.restoreMilliseconds.push_back(millisecondsSince(restoreStart));
+			}
+		}
+		return results;
+	}
+
+	// Both players in this process. Inputs stop changing before the end, so every prediction is settled by then and
+	// the two sides have to agree with a simulation fed the real inputs directly
+	LoopbackBenchResult measureLoopbackSession() {
+		LoopbackTransport transports[PLAYER_COUNT];
+		LoopbackTransport::connect(transports[0], transports[1]);
+		Simulation simulations[PLAYER_COUNT];
+		std::optional<RollbackSession> sessions[PLAYER_COUNT];
+		list<InputState> inputs[PLAYER_COUNT];
+		for (uint32_t player = 0; player < PLAYER_COUNT; ++player) {
+			transports[player].latency = LOOPBACK_BENCH_LATENCY;
+			sessions[player].emplace(simulations[player], transports[player], player);
+		}
+
+		LoopbackBenchResult result{{}, 0, 0, false};
+		BenchRandom random(LOOPBACK_BENCH_TICKS);
+		InputState held[PLAYER_COUNT];
+		while (simulations[0].getTick() < LOOPBACK_BENCH_TICKS || simulations[1].getTick() < LOOPBACK_BENCH_TICKS) {
+			for (uint32_t player = 0; player < PLAYER_COUNT; ++player) {
+				transports[player].advance();
+				if (simulations[player].getTick() >= LOOPBACK_BENCH_TICKS) continue;
+
+				const bool settling = simulations[player].getTick() + 2 * MAX_ROLLBACK_TICKS > LOOPBACK_BENCH_TICKS;
+				if (!settling && random.next() < 0.1f) {
+					held[player].buttons = static_cast<uint16_t>(random.next() * 128);
+				}
+
+				const auto tickStart = std::chrono::steady_clock::now();
+				if (sessions[player]->advance(held[player])) inputs[player].push_back(held[player]);
+				result.tickMilliseconds.push_back(millisecondsSince(tickStart));
+			}
+		}
+
+		Simulation reference;
+		for (uint32_t tick = 0; tick < LOOPBACK_BENCH_TICKS; ++tick) {
+			reference.step({inputs[0][tick], inputs[1][tick]});
+		}
+		result.inSync = simulations[0].getChecksum() == reference.getChecksum() &&
+						simulations[1].getChecksum() == reference.getChecksum();
+		for (const std::optional<RollbackSession> &session : sessions) {
+			result.rollbacks += session->getRollbackCount();
+			result.resimulatedTicks += session->getResimulatedTicks();
+		}
+		return result;
+	}
+
+	// Renders the default scene, then the golden scenes, and checks every captured frame. The run fails when a frame
+	// differs, has no golden image, or was not captured at all
+	void runGoldenTest() {
+		runGoldenScene("default");
+		for (const BenchScene &scene : GOLDEN_SCENES) {
+			loadBenchScene(scene);
+			runGoldenScene(scene.name);
+		}
+
+		const uint32_t capturesPerScene = (GOLDEN_FRAMES + GOLDEN_CAPTURE_INTERVAL - 1) / GOLDEN_CAPTURE_INTERVAL;
+		const uint32_t expected = static_cast<uint32_t>(1 + std::size(GOLDEN_SCENES)) * capturesPerScene;
+		if (goldenFramesChecked != expected) {
+			std::cerr << "Only " << goldenFramesChecked << " of " << expected << " golden frames were captured"
+					  << std::endl;
+			goldenFailed = true;
+		}
+		std::cout << "Golden image test " << (goldenFailed ? "failed" : "passed") << std::endl;
+	}
+
+	void runGoldenScene(const std::string &name) {
+		LOG("Rendering golden scene " << name);
+		goldenScene = name;
+
+		// Frames only become deterministic once the streamed texture is uploaded and drawn, at the latest in the frame
+		// after the loader is done
+		while (assetLoader.pendingCount() > 0) {
 			drawNextFrame();
-		} while (!glfwWindowShouldClose(window) && glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS);
+		}
+		drawNextFrame();
+
+		for (uint32_t frame = 0; frame < GOLDEN_FRAMES; ++frame) {
+			fixedTime = static_cast<float>(frame) * GOLDEN_FRAME_TIME;
+			if (frame % GOLDEN_CAPTURE_INTERVAL == 0) captureFrameId = frame;
+			drawNextFrame();
+		}
+		fixedTime.reset();
 
+		// Only the last captures can still be in flight, the checks need them before the scene changes
 		vkDeviceWaitIdle(device);
+		readback.collect(timeline.completed(), [this](const ReadbackFrame &frame) { return onFrameCaptured(frame); });
+	}
+
+	// True when the frame went to the video encoder, which releases its slot once encoded
+	bool onFrameCaptured(const ReadbackFrame &frame) {
+		if (videoEncoder.isRunning()) {
+			videoEncoder.submit(frame);
+			return true;
+		}
+		checkGoldenFrame(frame);
+		return false;
+	}
+
+	void checkGoldenFrame(const ReadbackFrame &frame) {
+		if (!goldenDirectory) return;
+		++goldenFramesChecked;
+
+		const size_t pixelCount = static_cast<size_t>(frame.extent.width) * frame.extent.height;
+		const list<uint8_t> actual = toRgba(frame.pixels, pixelCount, frame.format);
+		const std::string path = *goldenDirectory + "/" + goldenScene + "_" + std::to_string(frame.id);
+
+		if (updateGolden) {
+			if (writePng(path + ".png", frame.extent.width, frame.extent.height, actual.data())) {
+				std::cout << "Updated " << path << ".png" << std::endl;
+			} else {
+				std::cerr << path << ".png: failed to write" << std::endl;
+				goldenFailed = true;
+			}
+			return;
+		}
+
+		int width, height, channels;
+		stbi_uc *golden = stbi_load((path + ".png").c_str(), &width, &height, &channels, STBI_rgb_alpha);
+		const bool found = golden != nullptr;
+		const bool sameSize = found && static_cast<uint32_t>(width) == frame.extent.width &&
+							  static_cast<uint32_t>(height) == frame.extent.height;
+
+		ImageDifference difference;
+		if (sameSize) difference = compareImages(actual.data(), golden, pixelCount, GOLDEN_TOLERANCE);
+		stbi_image_free(golden);
+
+		if (!found) {
+			std::cerr << path << ".png: missing, run make update-golden first" << std::endl;
+		} else if (!sameSize) {
+			std::cerr << path << ".png: not " << frame.extent.width << "x" << frame.extent.height << std::endl;
+		} else if (difference.pixelsOverTolerance > 0) {
+			std::cerr << path << ".png: " << difference.pixelsOverTolerance << " pixels differ, by up to "
+					  << static_cast<int>(difference.maxDifference) << std::endl;
+		} else {
+			return;
+		}
+
+		// Written next to the golden image for inspection
+		if (!writePng(path + ".actual.png", frame.extent.width, frame.extent.height, actual.data())) {
+			std::cerr << path << ".actual.png: failed to write" << std::endl;
+		}
+		goldenFailed = true;
+	}
+
+	// Not measured, so it simply waits for the previous scene to be done with everything it replaces
+	void loadBenchScene(const BenchScene &scene) {
+		LOG("Loading benchmark scene " << scene.name);
+		vkDeviceWaitIdle(device);
+		destroySpriteTextures();
+
+		const VkExtent2D defaultExtent = {WIDTH, HEIGHT};
+		if (headlessExtent.width != defaultExtent.width || headlessExtent.height != defaultExtent.height) {
+			headlessExtent = defaultExtent;
+			recreateSwapChain();
+		}
+
+		// Scattered over the quad the single sprite covers, in the same winding and texture coordinates
+		const std::array<std::pair<glm::vec2, glm::vec2>, 4> corners = {{
+			{{-1.0f, -1.0f}, {1.0f, 0.0f}},
+			{{1.0f, -1.0f}, {0.0f, 0.0f}},
+			{{1.0f, 1.0f}, {0.0f, 1.0f}},
+			{{-1.0f, 1.0f}, {1.0f, 1.0f}},
+		}};
+
+		BenchRandom random(scene.spriteCount);
+		list<DrawVertex> spriteVertices;
+		spriteVertices.reserve(static_cast<size_t>(scene.spriteCount) * 4);
+		for (uint32_t i = 0; i < scene.spriteCount; ++i) {
+			const glm::vec2 center(random.next() - 0.5f, random.next() - 0.5f);
+			const float halfSize = 0.01f + 0.04f * random.next();
+			const glm::vec3 color(random.next(), random.next(), random.next());
+
+			for (const auto &[position, texCoord] : corners) {
+				spriteVertices.push_back(DrawVertex{center + position * halfSize, color, texCoord});
+			}
+		}
+
+		clearMappedBuffer(vertexBuffer, vertexBufferMemory);
+		createAndAllocBuffer(sizeof(spriteVertices[0]) * spriteVertices.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+							 spriteVertices.data(), vertexBuffer, vertexBufferMemory);
+		spriteCount = scene.spriteCount;
+
+		// The variant index is the pipeline id of the sort key
+		constexpr auto fitsPipelineIds = [](const BenchScene &each) { return each.pipelineCount <= MAX_PIPELINE_IDS; };
+		static_assert(std::ranges::all_of(BENCH_SCENES, fitsPipelineIds) &&
+						  std::ranges::all_of(GOLDEN_SCENES, fitsPipelineIds),
+					  "Too many pipeline variants in a scene for the draw sort key");
+		spritePipelineKeys.clear();
+		for (uint32_t i = 0; i < scene.pipelineCount; ++i) {
+			spritePipelineKeys.push_back(getBenchPipelineKey(i));
+		}
+		spritePipelines.resize(spritePipelineKeys.size());
+
+		createSpriteTextures(scene.textureCount - 1, random);
+	}
+
+	// 4x4 solid colors, their descriptor sets come from the frame allocators like the streamed texture's
+	void createSpriteTextures(const uint32_t count, BenchRandom &random) {
+		spriteTextures.resize(count);
+		for (SpriteTexture &texture : spriteTextures) {
+			const uint32_t color = 0xFF000000 | static_cast<uint32_t>(random.next() * 0xFFFFFF);
+			std::array<uint32_t, 16> pixels;
+			pixels.fill(color);
+
+			VkBuffer stagingBuffer;
+			VkDeviceMemory stagingBufferMemory;
+			createStagingBuffer(stagingBuffer, stagingBufferMemory, pixels.data(), sizeof(pixels));
+			const ImageDesc desc =
+				createTextureFromStaging(stagingBuffer, 0, 4, 4, texture.image, texture.imageMemory);
+			retireBuffer(stagingBuffer, stagingBufferMemory);
+			texture.imageView = createImageView(texture.image, desc.format);
+		}
+	}
+
+	// Only valid once the device is done with the textures
+	void destroySpriteTextures() {
+		for (const SpriteTexture &texture : spriteTextures) {
+			releaseImageView(texture.imageView);
+			vkDestroyImage(device, texture.image, VK_NULL_HANDLE);
+			memory.free(texture.imageMemory);
+		}
+		spriteTextures.clear();
 	}
 
 	void cleanupSwapchain() {
 		LOG("Destroying image views");
 		for (auto imageView : swapChainImageViews) {
-			vkDestroyImageView(device, imageView, VK_NULL_HANDLE);
+			releaseImageView(imageView);
 		}
 
 		LOG("Destroying framebuffers");
@@ -1696,51 +2687,90 @@ class TouhouEngine {
 	}
 
 	void cleanup() {
+		LOG("Stopping worker threads");
+		shaderWatcher.stop();
+		stagingRing.close();
+		jobs.stop();
+		if (pipelineRebuild) discardPipelineRebuild();
+
+		LOG("Flushing deletion queue");
+		deletionQueue.flush();
+
 		LOG("Destroying synchronization objects");
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
 			vkDestroySemaphore(device, imageAvailableSemaphores[i], VK_NULL_HANDLE);
 			vkDestroySemaphore(device, renderFinishedSemaphores[i], VK_NULL_HANDLE);
-			vkDestroyFence(device, waitFrameFences[i], VK_NULL_HANDLE);
 		}
+		timeline.destroy();
 
 		LOG("Cleaning up swap chain");
 		cleanupSwapchain();
 
-		LOG("Destroying texture sampler");
-		vkDestroySampler(device, textureSampler, VK_NULL_HANDLE);
+		LOG("Destroying frame graph images");
+		for (size_t i = 0; i < frameGraphImages.size(); ++i) {
+			vkDestroyImage(device, frameGraphImages[i], VK_NULL_HANDLE);
+			memory.free(frameGraphImagesMemory[i]);
+		}
+
+		LOG("Releasing texture sampler");
+		releaseSampler(textureSampler);
+
+		LOG("Releasing textures image view");
+		releaseImageView(textureImageView);
 
-		LOG("Destroying textures image view");
-		vkDestroyImageView(device, textureImageView, VK_NULL_HANDLE);
+		LOG("Destroying sprite textures");
+		destroySpriteTextures();
 
 		LOG("Destroying textures images");
 		vkDestroyImage(device, textureImage, VK_NULL_HANDLE);
-		vkFreeMemory(device, textureImageMemory, VK_NULL_HANDLE);
+		memory.free(textureImageMemory);
+
+		if (captureEnabled) {
+			LOG("Destroying readback ring");
+			vkDestroyBuffer(device, readback.buffer, VK_NULL_HANDLE);
+			memory.free(readbackMemory);
+		}
+
+		LOG("Destroying staging ring");
+		vkDestroyBuffer(device, stagingRing.buffer, VK_NULL_HANDLE);
+		memory.free(stagingRingMemory);
 
 		LOG("Cleaning up uniform buffers");
 		for (size_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
 			vkDestroyBuffer(device, uniformBuffers[i], VK_NULL_HANDLE);
-			vkFreeMemory(device, uniformBuffersMemory[i], VK_NULL_HANDLE);
+			memory.free(uniformBuffersMemory[i]);
 		}
 
-		LOG("Destroying descriptor pool");
-		vkDestroyDescriptorPool(device, descriptorPool, VK_NULL_HANDLE);
+		LOG("Destroying descriptor pools");
+		for (DescriptorAllocator &allocator : frameDescriptors) {
+			allocator.destroy();
+		}
 
-		LOG("Cleaning up descriptor set layout");
-		vkDestroyDescriptorSetLayout(device, descriptorSetLayout, VK_NULL_HANDLE);
+		LOG("Releasing descriptor set layout");
+		releaseDescriptorSetLayout(descriptorSetLayout);
 
 		LOG("Destroying vertex buffer");
 		vkDestroyBuffer(device, vertexBuffer, VK_NULL_HANDLE);
-		vkFreeMemory(device, vertexBufferMemory, VK_NULL_HANDLE);
+		memory.free(vertexBufferMemory);
 
 		LOG("Destroying index buffer");
 		vkDestroyBuffer(device, indexBuffer, VK_NULL_HANDLE);
-		vkFreeMemory(device, indexBufferMemory, VK_NULL_HANDLE);
+		memory.free(indexBufferMemory);
 
 		LOG("Destroying command pool");
 		vkDestroyCommandPool(device, commandPool, VK_NULL_HANDLE);
 
-		LOG("Destroying graphics pipeline");
-		vkDestroyPipeline(device, graphicsPipeline, VK_NULL_HANDLE);
+		LOG("Destroying graphics pipeline variants");
+		for (const auto &[key, pipeline] : pipelineVariants) {
+			vkDestroyPipeline(device, pipeline, VK_NULL_HANDLE);
+		}
+
+		LOG("Destroying shader modules");
+		vkDestroyShaderModule(device, fragShaderModule, VK_NULL_HANDLE);
+		vkDestroyShaderModule(device, vertShaderModule, VK_NULL_HANDLE);
+
+		LOG("Destroying pipeline cache");
+		vkDestroyPipelineCache(device, pipelineCache, VK_NULL_HANDLE);
 
 		LOG("Destroying graphics pipeline layout");
 		vkDestroyPipelineLayout(device, pipelineLayout, VK_NULL_HANDLE);
@@ -1762,17 +2792,51 @@ class TouhouEngine {
 		LOG("Destroying Vulkan instance");
 		vkDestroyInstance(instance, VK_NULL_HANDLE);
 
-		LOG("Deleting window GLFW");
-		glfwDestroyWindow(window);
+		if (!headless) {
+			LOG("Deleting window GLFW");
+			glfwDestroyWindow(window);
 
-		LOG("Terminating GLFW");
-		glfwTerminate();
+			LOG("Terminating GLFW");
+			glfwTerminate();
+		}
 	}
 };
 
-int main() {
+int main(const int argc, char **argv) {
 	TouhouEngine engine;
 
+	for (int i = 1; i < argc; ++i) {
+		if (IS_STR_EQUAL(argv[i], "--bench") && i + 1 < argc) {
+			engine.benchReportPath = argv[++i];
+			engine.headless = true;
+		} else if ((IS_STR_EQUAL(argv[i], "--golden") || IS_STR_EQUAL(argv[i], "--update-golden")) && i + 1 < argc) {
+			engine.updateGolden = IS_STR_EQUAL(argv[i], "--update-golden");
+			engine.goldenDirectory = argv[++i];
+			engine.headless = engine.captureEnabled = true;
+		} else if (IS_STR_EQUAL(argv[i], "--capture") && i + 1 < argc) {
+			engine.capturePath = argv[++i];
+			engine.captureEnabled = true;
+		} else if (IS_STR_EQUAL(argv[i], "--record") && i + 1 < argc) {
+			engine.recordPath = argv[++i];
+		} else if (IS_STR_EQUAL(argv[i], "--replay") && i + 1 < argc) {
+			engine.replayPath = argv[++i];
+		} else if (IS_STR_EQUAL(argv[i], "--host") && i + 1 < argc && parsePort(argv[i + 1])) {
+			engine.netplayPort = *parsePort(argv[++i]);
+		} else if (IS_STR_EQUAL(argv[i], "--join") && i + 1 < argc && strchr(argv[i + 1], ':') &&
+				   parsePort(strrchr(argv[i + 1], ':') + 1)) {
+			const std::string address = argv[++i];
+			const size_t separator = address.rfind(':');
+			engine.netplayHost = address.substr(0, separator);
+			engine.netplayPort = *parsePort(std::string_view(address).substr(separator + 1));
+		} else {
+			std::cerr << "Usage: " << argv[0]
+					  << " [--bench <report.json> | --golden <directory> | --update-golden <directory> |"
+					  << " --capture <video.y4m | directory> | --record <input> | --replay <input> | --host <port> |"
+					  << " --join <host:port>]" << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
 	try {
 		engine.run();
 	} catch (const std::exception &e) {
@@ -1780,5 +2844,5 @@ int main() {
 		return EXIT_FAILURE;
 	}
 
-	return EXIT_SUCCESS;
+	return engine.goldenFailed || engine.benchFailed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+enum class MemoryCategory : uint32_t {
+	Textures,
+	RenderTargets,
+	Buffers,
+	Staging,
+};
+
+constexpr size_t MEMORY_CATEGORY_COUNT = 4;
+
+inline const char *getMemoryCategoryName(const MemoryCategory category) {
+	switch (category) {
+	case MemoryCategory::Textures:
+		return "textures";
+	case MemoryCategory::RenderTargets:
+		return "renderTargets";
+	case MemoryCategory::Buffers:
+		return "buffers";
+	case MemoryCategory::Staging:
+		return "staging";
+	}
+	return "unknown";
+}
+
+struct HeapStats {
+	VkDeviceSize size, budget;
+	// Reported by the driver with VK_EXT_memory_budget, which includes other processes, otherwise what we allocated
+	VkDeviceSize usage;
+	VkDeviceSize allocated;
+	bool deviceLocal;
+};
+
+struct MemoryStats {
+	bool hasBudgetExtension;
+	list<HeapStats> heaps;
+	std::array<VkDeviceSize, MEMORY_CATEGORY_COUNT> categoryBytes;
+	std::array<uint32_t, MEMORY_CATEGORY_COUNT> categoryAllocations;
+};
+
+// Every device memory allocation goes through here, so usage is known per heap and per category. The budget comes
+// from VK_EXT_memory_budget when the device has it, and is a fixed share of the heap size otherwise
+class MemoryTracker {
+  public:
+	// Without the extension, the OS and other processes are assumed to need the rest of the heap
+	static constexpr double FALLBACK_BUDGET_RATIO = 0.8;
+
+	void create(const VkInstance instance, const VkPhysicalDevice physicalDevice, const VkDevice device,
+				const VkPhysicalDeviceMemoryProperties &memoryProperties, const bool hasBudgetExtension) {
+		this->physicalDevice = physicalDevice;
+		this->device = device;
+		this->memoryProperties = memoryProperties;
+
+		if (hasBudgetExtension) {
+			vkGetPhysicalDeviceMemoryProperties2KHR = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)
+				vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+		}
+		LOG("Memory budget " << (vkGetPhysicalDeviceMemoryProperties2KHR ? "reported by VK_EXT_memory_budget"
+																		  : "estimated from the heap sizes"));
+
+		heaps.resize(memoryProperties.memoryHeapCount);
+		updateBudget();
+	}
+
+	uint32_t findMemoryType(const uint32_t typeFilter, const VkMemoryPropertyFlags properties) const {
+		for (uint32_t i = 0; i < memoryProperties.memoryTypeCount; i++) {
+			if (typeFilter & (1 << i) && (memoryProperties.memoryTypes[i].propertyFlags & properties) == properties) {
+				return i;
+			}
+		}
+
+		ERROR("Failed to find suitable memory type!");
+		return 0;
+	}
+
+	VkDeviceMemory allocate(const VkMemoryRequirements &requirements, const VkMemoryPropertyFlags properties,
+							const MemoryCategory category) {
+		const uint32_t memoryType = findMemoryType(requirements.memoryTypeBits, properties);
+		const VkMemoryAllocateInfo allocInfo{
+			.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.allocationSize = requirements.size,
+			.memoryTypeIndex = memoryType,
+		};
+
+		VkDeviceMemory memory;
+		VK_CHECK(vkAllocateMemory(device, &allocInfo, VK_NULL_HANDLE, &memory), "Failed to allocate device memory!");
+
+		const Allocation allocation{requirements.size, memoryProperties.memoryTypes[memoryType].heapIndex, category};
+		std::lock_guard lock(mutex);
+		allocations.emplace(memory, allocation);
+		heaps[allocation.heap].allocated += allocation.size;
+		categoryBytes[static_cast<size_t>(category)] += allocation.size;
+		++categoryAllocations[static_cast<size_t>(category)];
+		return memory;
+	}
+
+	void free(const VkDeviceMemory memory) {
+		if (memory == VK_NULL_HANDLE) return;
+		vkFreeMemory(device, memory, VK_NULL_HANDLE);
+
+		std::lock_guard lock(mutex);
+		const auto it = allocations.find(memory);
+		if (it == allocations.end()) return;
+
+		const Allocation &allocation = it->second;
+		heaps[allocation.heap].allocated -= allocation.size;
+		categoryBytes[static_cast<size_t>(allocation.category)] -= allocation.size;
+		--categoryAllocations[static_cast<size_t>(allocation.category)];
+		allocations.erase(it);
+	}
+
+	// Cheap, but the driver values only change every few frames, so there is no point in calling it every frame
+	void updateBudget() {
+		std::lock_guard lock(mutex);
+		if (!vkGetPhysicalDeviceMemoryProperties2KHR) {
+			for (uint32_t i = 0; i < heaps.size(); ++i) {
+				const VkDeviceSize heapSize = memoryProperties.memoryHeaps[i].size;
+				heaps[i].budget = static_cast<VkDeviceSize>(static_cast<double>(heapSize) * FALLBACK_BUDGET_RATIO);
+				heaps[i].usage = heaps[i].allocated;
+			}
+			return;
+		}
+
+		VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT,
+			.pNext = VK_NULL_HANDLE,
+			.heapBudget = {},
+			.heapUsage = {},
+		};
+		VkPhysicalDeviceMemoryProperties2KHR properties{
+			.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR,
+			.pNext = &budgetProperties,
+			.memoryProperties = {},
+		};
+		vkGetPhysicalDeviceMemoryProperties2KHR(physicalDevice, &properties);
+
+		for (uint32_t i = 0; i < heaps.size(); ++i) {
+			heaps[i].budget = budgetProperties.heapBudget[i];
+			heaps[i].usage = budgetProperties.heapUsage[i];
+		}
+	}
+
+	// Highest usage over budget ratio among the device local heaps, above 1 means over budget
+	double getDeviceLocalPressure() const {
+		std::lock_guard lock(mutex);
+		double pressure = 0.0;
+		for (uint32_t i = 0; i < heaps.size(); ++i) {
+			if (!(memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) || heaps[i].budget == 0) {
+				continue;
+			}
+			pressure = std::max(pressure, static_cast<double>(heaps[i].usage) / static_cast<double>(heaps[i].budget));
+		}
+		return pressure;
+	}
+
+	MemoryStats getStats() const {
+		std::lock_guard lock(mutex);
+		MemoryStats stats{
+			.hasBudgetExtension = vkGetPhysicalDeviceMemoryProperties2KHR != VK_NULL_HANDLE,
+			.heaps = {},
+			.categoryBytes = categoryBytes,
+			.categoryAllocations = categoryAllocations,
+		};
+		for (uint32_t i = 0; i < heaps.size(); ++i) {
+			stats.heaps.push_back(HeapStats{
+				.size = memoryProperties.memoryHeaps[i].size,
+				.budget = heaps[i].budget,
+				.usage = heaps[i].usage,
+				.allocated = heaps[i].allocated,
+				.deviceLocal = (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0,
+			});
+		}
+		return stats;
+	}
+
+	// Single line JSON object, so it can be grepped out of the log
+	static void writeStats(std::ostream &out, const MemoryStats &stats) {
+		out << "{\"budgetExtension\":" << (stats.hasBudgetExtension ? "true" : "false") << ",\"heaps\":[";
+		for (size_t i = 0; i < stats.heaps.size(); ++i) {
+			const HeapStats &heap = stats.heaps[i];
+			out << (i ? "," : "") << "{\"size\":" << heap.size << ",\"budget\":" << heap.budget
+				<< ",\"usage\":" << heap.usage << ",\"allocated\":" << heap.allocated
+				<< ",\"deviceLocal\":" << (heap.deviceLocal ? "true" : "false") << "}";
+		}
+		out << "],\"categories\":{";
+		for (size_t i = 0; i < MEMORY_CATEGORY_COUNT; ++i) {
+			out << (i ? "," : "") << "\"" << getMemoryCategoryName(static_cast<MemoryCategory>(i))
+				<< "\":{\"bytes\":" << stats.categoryBytes[i] << ",\"allocations\":" << stats.categoryAllocations[i]
+				<< "}";
+		}
+		out << "}}";
+	}
+
+  private:
+	struct Allocation {
+		VkDeviceSize size;
+		uint32_t heap;
+		MemoryCategory category;
+	};
+
+	struct Heap {
+		VkDeviceSize budget = 0, usage = 0, allocated = 0;
+	};
+
+	VkPhysicalDevice physicalDevice = VK_NULL_HANDLE;
+	VkDevice device = VK_NULL_HANDLE;
+	VkPhysicalDeviceMemoryProperties memoryProperties{};
+	PFN_vkGetPhysicalDeviceMemoryProperties2KHR vkGetPhysicalDeviceMemoryProperties2KHR = VK_NULL_HANDLE;
+
+	mutable std::mutex mutex;
+	std::unordered_map<VkDeviceMemory, Allocation> allocations;
+	list<Heap> heaps;
+	std::array<VkDeviceSize, MEMORY_CATEGORY_COUNT> categoryBytes{};
+	std::array<uint32_t, MEMORY_CATEGORY_COUNT> categoryAllocations{};
+};
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "input.h"
+#include "simulation.h"
+#include "utils.h"
+
+// Ticks the local simulation may run ahead of the last confirmed remote input. Bounds both the snapshots kept and the
+// ticks a single rollback resimulates, so the worst case frame costs that many steps plus one restore
+constexpr uint32_t MAX_ROLLBACK_TICKS = 8;
+// Inputs kept per player, older ones can no longer be resent
+constexpr uint32_t INPUT_HISTORY = 64;
+constexpr size_t MAX_PACKET_SIZE = 16 + INPUT_HISTORY * sizeof(uint16_t);
+
+// Port of a --host or --join argument, nothing unless the whole text is a number from 1 to 65535
+inline std::optional<uint16_t> parsePort(const std::string_view text) {
+	uint32_t port = 0;
+	const char *end = text.data() + text.size();
+	const auto [parsed, error] = std::from_chars(text.data(), end, port);
+	if (error != std::errc() || parsed != end || port == 0 || port > UINT16_MAX) return std::nullopt;
+	return static_cast<uint16_t>(port);
+}
+
+// Unreliable, unordered datagrams. receive never blocks
+class Transport {
+  public:
+	virtual ~Transport() = default;
+
+	virtual void send(const uint8_t *data, size_t size) = 0;
+	// Size of the next packet, 0 when none is waiting
+	virtual size_t receive(uint8_t *buffer, size_t capacity) = 0;
+};
+
+// In process pair, packets are delivered once latency calls to advance have passed since they were sent
+class LoopbackTransport : public Transport {
+  public:
+	uint32_t latency = 0;
+
+	static void connect(LoopbackTransport &a, LoopbackTransport &b) {
+		a.peer = &b;
+		b.peer = &a;
+	}
+
+	void advance() { ++time; }
+
+	void send(const uint8_t *data, const size_t size) override {
+		peer->packets.push_back(Packet{list<uint8_t>(data, data + size), peer->time + latency});
+	}
+
+	size_t receive(uint8_t *buffer, const size_t capacity) override {
+		if (packets.empty() || packets.front().deliveryTime > time) return 0;
+
+		const size_t size = std::min(packets.front().data.size(), capacity);
+		memcpy(buffer, packets.front().data.data(), size);
+		packets.pop_front();
+		return size;
+	}
+
+  private:
+	struct Packet {
+		list<uint8_t> data;
+		uint64_t deliveryTime;
+	};
+
+	LoopbackTransport *peer = nullptr;
+	std::deque<Packet> packets;
+	uint64_t time = 0;
+};
+
+// IPv4 datagrams on a non blocking socket. Without a peer, the sender of the first packet received becomes it
+class UdpTransport : public Transport {
+  public:
+	~UdpTransport() {
+		if (socketHandle >= 0) close(socketHandle);
+	}
+
+	// Port 0 lets the system pick one
+	bool open(const uint16_t port) {
+		socketHandle = socket(AF_INET, SOCK_DGRAM, 0);
+		if (socketHandle < 0) return false;
+
+		const sockaddr_in address{
+			.sin_family = AF_INET,
+			.sin_port = htons(port),
+			.sin_addr = {.s_addr = htonl(INADDR_ANY)},
+			.sin_zero = {},
+		};
+		return fcntl(socketHandle, F_SETFL, fcntl(socketHandle, F_GETFL) | O_NONBLOCK) == 0 &&
+			   bind(socketHandle, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == 0;
+	}
+
+	bool connectTo(const std::string &host, const uint16_t port) {
+		const addrinfo hints{
+			.ai_flags = 0,
+			.ai_family = AF_INET,
+			.ai_socktype = SOCK_DGRAM,
+			.ai_protocol = 0,
+			.ai_addrlen = 0,
+			.ai_addr = nullptr,
+			.ai_canonname = nullptr,
+			.ai_next = nullptr,
+		};
+		addrinfo *result = nullptr;
+		if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &result) != 0) return false;
+
+		memcpy(&peer, result->ai_addr, sizeof(peer));
+		freeaddrinfo(result);
+		hasPeer = true;
+		return true;
+	}
+
+	void send(const uint8_t *data, const size_t size) override {
+		if (!hasPeer) return;
+		sendto(socketHandle, data, size, 0, reinterpret_cast<const sockaddr *>(&peer), sizeof(peer));
+	}
+
+	size_t receive(uint8_t *buffer, const size_t capacity) override {
+		while (true) {
+			sockaddr_in sender;
+			socklen_t senderSize = sizeof(sender);
+			const ssize_t size =
+				recvfrom(socketHandle, buffer, capacity, 0, reinterpret_cast<sockaddr *>(&sender), &senderSize);
+			if (size <= 0) return 0;
+
+			if (!hasPeer) {
+				peer = sender;
+				hasPeer = true;
+			}
+			// Anyone else is ignored
+			if (sender.sin_addr.s_addr == peer.sin_addr.s_addr && sender.sin_port == peer.sin_port) {
+				return static_cast<size_t>(size);
+			}
+		}
+	}
+
+  private:
+	int socketHandle = -1;
+	sockaddr_in peer{};
+	bool hasPeer = false;
+};
+
+// Two player rollback on top of a transport. Every tick runs at once with the local input and a prediction of the
+// remote one, the last confirmed remote input repeated. When the real remote input of a simulated tick turns out to
+// differ, the state saved before that tick is restored and the ticks since are simulated again
+class RollbackSession {
+  public:
+	RollbackSession(Simulation &simulation, Transport &transport, const uint32_t localPlayer)
+		: simulation(simulation), transport(transport), localPlayer(localPlayer) {
+		snapshots.resize(static_cast<size_t>(MAX_ROLLBACK_TICKS + 1) * Simulation::MAX_SNAPSHOT_SIZE);
+		tick = simulation.getTick();
+		remoteConfirmed = localAcknowledged = tick;
+	}
+
+	// False when the tick has to wait, the remote being too far behind for a rollback to cover
+	bool advance(const InputState localInput) {
+		receiveInputs();
+
+		if (tick >= remoteConfirmed + MAX_ROLLBACK_TICKS) {
+			++stallCount;
+			sendInputs();
+			return false;
+		}
+
+		if (rollbackTick) {
+			++rollbackCount;
+			simulation.restore(getSnapshot(*rollbackTick));
+			for (uint64_t resimulated = *rollbackTick; resimulated < tick; ++resimulated) {
+				simulateTick(resimulated);
+				++resimulatedTicks;
+			}
+			rollbackTick.reset();
+		}
+
+		localInputs[tick % INPUT_HISTORY] = localInput;
+		simulateTick(tick++);
+		sendInputs();
+		return true;
+	}
+
+	uint64_t getRollbackCount() const { return rollbackCount; }
+	uint64_t getResimulatedTicks() const { return resimulatedTicks; }
+	uint64_t getStallCount() const { return stallCount; }
+
+  private:
+	static constexpr char MAGIC[4] = {'T', 'H', 'N', 'P'};
+
+	Simulation &simulation;
+	Transport &transport;
+	const uint32_t localPlayer;
+
+	// Snapshot of the state before each of the last ticks, in one block allocated up front
+	list<uint8_t> snapshots;
+
+	uint64_t tick = 0;
+	InputState localInputs[INPUT_HISTORY];
+	// Remote inputs of every tick before remoteConfirmed are known, the remote has every local one before
+	// localAcknowledged
+	InputState remoteInputs[INPUT_HISTORY], predictedInputs[INPUT_HISTORY];
+	uint64_t remoteConfirmed = 0, localAcknowledged = 0;
+	std::optional<uint64_t> rollbackTick;
+
+	uint64_t rollbackCount = 0, resimulatedTicks = 0, stallCount = 0;
+
+	uint8_t *getSnapshot(const uint64_t snapshotTick) {
+		return snapshots.data() + snapshotTick % (MAX_ROLLBACK_TICKS + 1) * Simulation::MAX_SNAPSHOT_SIZE;
+	}
+
+	void simulateTick(const uint64_t simulatedTick) {
+		simulation.save(getSnapshot(simulatedTick));
+
+		const InputState remoteInput = getRemoteInput(simulatedTick);
+		predictedInputs[simulatedTick % INPUT_HISTORY] = remoteInput;
+
+		TickInputs inputs;
+		inputs[localPlayer] = localInputs[simulatedTick % INPUT_HISTORY];
+		inputs[(localPlayer + 1) % PLAYER_COUNT] = remoteInput;
+		simulation.step(inputs);
+	}
+
+	// Confirmed, or predicted to be the last confirmed one
+	InputState getRemoteInput(const uint64_t remoteTick) const {
+		if (remoteTick < remoteConfirmed) return remoteInputs[remoteTick % INPUT_HISTORY];
+		if (remoteConfirmed == 0) return InputState{};
+		return remoteInputs[(remoteConfirmed - 1) % INPUT_HISTORY];
+	}
+
+	static void writeLittleEndian(uint8_t *out, const uint64_t value, const uint32_t size) {
+		for (uint32_t i = 0; i < size; ++i) {
+			out[i] = static_cast<uint8_t>(value >> (8 * i));
+		}
+	}
+
+	static uint64_t readLittleEndian(const uint8_t *in, const uint32_t size) {
+		uint64_t value = 0;
+		for (uint32_t i = 0; i < size; ++i) {
+			value |= static_cast<uint64_t>(in[i]) << (8 * i);
+		}
+		return value;
+	}
+
+	// Magic, the remote ticks confirmed, the first tick sent, the input count, then every local input the remote has
+	// not acknowledged yet, so a lost packet is covered by the next one
+	void sendInputs() {
+		const uint64_t first = std::max(localAcknowledged, tick > INPUT_HISTORY ? tick - INPUT_HISTORY : 0);
+		const uint32_t count = static_cast<uint32_t>(tick - first);
+
+		uint8_t packet[MAX_PACKET_SIZE];
+		memcpy(packet, MAGIC, sizeof(MAGIC));
+		writeLittleEndian(packet + 4, remoteConfirmed, 4);
+		writeLittleEndian(packet + 8, first, 4);
+		writeLittleEndian(packet + 12, count, 2);
+		for (uint32_t i = 0; i < count; ++i) {
+			writeLittleEndian(packet + 14 + 2 * i, localInputs[(first + i) % INPUT_HISTORY].buttons, 2);
+		}
+		transport.send(packet, 14 + 2 * count);
+	}
+
+	void receiveInputs() {
+		uint8_t packet[MAX_PACKET_SIZE];
+		for (size_t size; (size = transport.receive(packet, sizeof(packet))) != 0;) {
+			if (size < 14 || memcmp(packet, MAGIC, sizeof(MAGIC)) != 0) continue;
+
+			localAcknowledged = std::max(localAcknowledged, readLittleEndian(packet + 4, 4));
+			const uint64_t first = readLittleEndian(packet + 8, 4);
+			const uint32_t count = static_cast<uint32_t>(readLittleEndian(packet + 12, 2));
+			if (size < 14 + 2 * static_cast<size_t>(count)) continue;
+
+			// Only the next missing input is taken each time, so the confirmed ones stay contiguous
+			for (uint64_t remoteTick = remoteConfirmed; remoteTick >= first && remoteTick < first + count;
+				 ++remoteTick) {
+				const uint8_t *buttons = packet + 14 + 2 * (remoteTick - first);
+				const InputState input{static_cast<uint16_t>(readLittleEndian(buttons, 2))};
+				remoteInputs[remoteTick % INPUT_HISTORY] = input;
+				++remoteConfirmed;
+
+				if (remoteTick < tick && input != predictedInputs[remoteTick % INPUT_HISTORY]) {
+					rollbackTick = std::min(rollbackTick.value_or(remoteTick), remoteTick);
+				}
+			}
+		}
+	}
+};
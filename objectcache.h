@@ -0,0 +1,216 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+#include <vulkan/vulkan.h>
+
+#include "smalllist.h"
+#include "utils.h"
+
+// Same mixing as the pipeline key hash, one field after the other
+template <typename... Fields> size_t hashFields(const Fields &...fields) {
+	size_t seed = 0;
+	((seed ^= std::hash<Fields>{}(fields) + 0x9e3779b9 + (seed << 6) + (seed >> 2)), ...);
+	return seed;
+}
+
+// Keys hold the contents of a create info, so two create infos written separately but alike find the same object.
+// Extension structures are not part of them, the create infos must not have any
+
+struct SamplerKey {
+	VkSamplerCreateFlags flags;
+	VkFilter magFilter, minFilter;
+	VkSamplerMipmapMode mipmapMode;
+	VkSamplerAddressMode addressModeU, addressModeV, addressModeW;
+	float mipLodBias;
+	VkBool32 anisotropyEnable;
+	float maxAnisotropy;
+	VkBool32 compareEnable;
+	VkCompareOp compareOp;
+	float minLod, maxLod;
+	VkBorderColor borderColor;
+	VkBool32 unnormalizedCoordinates;
+
+	static SamplerKey fromCreateInfo(const VkSamplerCreateInfo &info) {
+		VALIDATE(info.pNext == VK_NULL_HANDLE, "Cached samplers cannot have extension structures");
+		return SamplerKey{
+			.flags = info.flags,
+			.magFilter = info.magFilter,
+			.minFilter = info.minFilter,
+			.mipmapMode = info.mipmapMode,
+			.addressModeU = info.addressModeU,
+			.addressModeV = info.addressModeV,
+			.addressModeW = info.addressModeW,
+			.mipLodBias = info.mipLodBias,
+			.anisotropyEnable = info.anisotropyEnable,
+			.maxAnisotropy = info.maxAnisotropy,
+			.compareEnable = info.compareEnable,
+			.compareOp = info.compareOp,
+			.minLod = info.minLod,
+			.maxLod = info.maxLod,
+			.borderColor = info.borderColor,
+			.unnormalizedCoordinates = info.unnormalizedCoordinates,
+		};
+	}
+
+	bool operator==(const SamplerKey &) const = default;
+};
+
+template <> struct std::hash<SamplerKey> {
+	size_t operator()(const SamplerKey &key) const noexcept {
+		return hashFields(key.flags, key.magFilter, key.minFilter, key.mipmapMode, key.addressModeU, key.addressModeV,
+						  key.addressModeW, key.mipLodBias, key.anisotropyEnable, key.maxAnisotropy, key.compareEnable,
+						  key.compareOp, key.minLod, key.maxLod, key.borderColor, key.unnormalizedCoordinates);
+	}
+};
+
+struct ImageViewKey {
+	VkImageViewCreateFlags flags;
+	VkImage image;
+	VkImageViewType viewType;
+	VkFormat format;
+	VkComponentSwizzle r, g, b, a;
+	VkImageAspectFlags aspectMask;
+	uint32_t baseMipLevel, levelCount, baseArrayLayer, layerCount;
+
+	static ImageViewKey fromCreateInfo(const VkImageViewCreateInfo &info) {
+		VALIDATE(info.pNext == VK_NULL_HANDLE, "Cached image views cannot have extension structures");
+		return ImageViewKey{
+			.flags = info.flags,
+			.image = info.image,
+			.viewType = info.viewType,
+			.format = info.format,
+			.r = info.components.r,
+			.g = info.components.g,
+			.b = info.components.b,
+			.a = info.components.a,
+			.aspectMask = info.subresourceRange.aspectMask,
+			.baseMipLevel = info.subresourceRange.baseMipLevel,
+			.levelCount = info.subresourceRange.levelCount,
+			.baseArrayLayer = info.subresourceRange.baseArrayLayer,
+			.layerCount = info.subresourceRange.layerCount,
+		};
+	}
+
+	bool operator==(const ImageViewKey &) const = default;
+};
+
+template <> struct std::hash<ImageViewKey> {
+	size_t operator()(const ImageViewKey &key) const noexcept {
+		return hashFields(key.flags, key.image, key.viewType, key.format, key.r, key.g, key.b, key.a, key.aspectMask,
+						  key.baseMipLevel, key.levelCount, key.baseArrayLayer, key.layerCount);
+	}
+};
+
+struct DescriptorSetLayoutKey {
+	struct Binding {
+		uint32_t binding;
+		VkDescriptorType descriptorType;
+		uint32_t descriptorCount;
+		VkShaderStageFlags stageFlags;
+		bool hasImmutableSamplers;
+
+		bool operator==(const Binding &) const = default;
+	};
+
+	VkDescriptorSetLayoutCreateFlags flags;
+	small_list<Binding, 8> bindings;
+	// Those of every binding having them, one after the other
+	small_list<VkSampler, 4> immutableSamplers;
+
+	static DescriptorSetLayoutKey fromCreateInfo(const VkDescriptorSetLayoutCreateInfo &info) {
+		VALIDATE(info.pNext == VK_NULL_HANDLE, "Cached descriptor set layouts cannot have extension structures");
+		DescriptorSetLayoutKey key{.flags = info.flags, .bindings = {}, .immutableSamplers = {}};
+		for (uint32_t i = 0; i < info.bindingCount; ++i) {
+			const VkDescriptorSetLayoutBinding &binding = info.pBindings[i];
+			key.bindings.push_back(Binding{
+				.binding = binding.binding,
+				.descriptorType = binding.descriptorType,
+				.descriptorCount = binding.descriptorCount,
+				.stageFlags = binding.stageFlags,
+				.hasImmutableSamplers = binding.pImmutableSamplers != VK_NULL_HANDLE,
+			});
+			if (binding.pImmutableSamplers == VK_NULL_HANDLE) continue;
+
+			for (uint32_t sampler = 0; sampler < binding.descriptorCount; ++sampler) {
+				key.immutableSamplers.push_back(binding.pImmutableSamplers[sampler]);
+			}
+		}
+		return key;
+	}
+
+	bool operator==(const DescriptorSetLayoutKey &) const = default;
+};
+
+template <> struct std::hash<DescriptorSetLayoutKey> {
+	size_t operator()(const DescriptorSetLayoutKey &key) const noexcept {
+		size_t seed = hashFields(key.flags, key.bindings.size());
+		for (const DescriptorSetLayoutKey::Binding &binding : key.bindings) {
+			seed ^= hashFields(binding.binding, binding.descriptorType, binding.descriptorCount, binding.stageFlags,
+							   binding.hasImmutableSamplers) +
+					0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
+		for (const VkSampler sampler : key.immutableSamplers) {
+			seed ^= std::hash<VkSampler>{}(sampler) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
+		return seed;
+	}
+};
+
+// Vulkan objects shared by everyone asking for an equal key, counting their references. The last release takes the
+// object out of the cache right away but leaves destroying it to the caller, once the submissions that may still use
+// it have completed. A later acquire creates a new one, so a recycled handle, an image in a view key for instance,
+// never finds an object meant for the destroyed one
+template <typename Key, typename Handle> class ObjectCache {
+  public:
+	// create() is only called on a miss, with the cache locked
+	template <typename Create> Handle acquire(const Key &key, const Create &create) {
+		std::lock_guard lock(mutex);
+		if (const auto found = entries.find(key); found != entries.end()) {
+			++found->second.references;
+			return found->second.handle;
+		}
+
+		const Handle handle = create();
+		const auto inserted = entries.emplace(key, Entry{handle, 1}).first;
+		keys.emplace(handle, &inserted->first);
+		return handle;
+	}
+
+	// True when that was the last reference, the handle is the caller's to destroy
+	bool release(const Handle handle) {
+		std::lock_guard lock(mutex);
+		const auto key = keys.find(handle);
+		if (key == keys.end()) {
+			LOGE("Released an object the cache does not hold");
+			return false;
+		}
+
+		const auto entry = entries.find(*key->second);
+		if (--entry->second.references > 0) return false;
+
+		entries.erase(entry);
+		keys.erase(key);
+		return true;
+	}
+
+	size_t size() const {
+		std::lock_guard lock(mutex);
+		return entries.size();
+	}
+
+  private:
+	struct Entry {
+		Handle handle;
+		uint32_t references;
+	};
+
+	mutable std::mutex mutex;
+	std::unordered_map<Key, Entry> entries;
+	// Keys live in the nodes of entries, which never move
+	std::unordered_map<Handle, const Key *> keys;
+};
@@ -0,0 +1,99 @@
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <stb/stb_image.h>
+
+#include "archive.h"
+#include "ktx2.h"
+#include "utils.h"
+
+// Builds the asset archive loaded by the engine:
+//     packer.out <archive> <assets...>
+// Assets are named by the path given, which is the path the engine asks for
+
+constexpr uint32_t SPIRV_MAGIC = 0x07230203;
+
+static list<uint8_t> readBytes(const std::string &path) {
+	std::ifstream file(path, std::ios::ate | std::ios::binary);
+	VALIDATE(file.is_open(), "Failed to open file: " + path);
+
+	list<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+	file.seekg(0);
+	file.read(reinterpret_cast<char *>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+	return bytes;
+}
+
+static list<uint8_t> packSpirV(const std::string &path) {
+	list<uint8_t> code = readBytes(path);
+
+	uint32_t magic = 0;
+	if (code.size() >= sizeof(magic)) memcpy(&magic, code.data(), sizeof(magic));
+	VALIDATE(magic == SPIRV_MAGIC && code.size() % 4 == 0, "Not a SPIR-V module: " + path);
+	return code;
+}
+
+// Everything ends up as KTX2 in the format it is uploaded with, so the engine never decodes at runtime
+static list<uint8_t> packTexture(const std::string &path) {
+	if (path.ends_with(".ktx2")) {
+		list<uint8_t> file = readBytes(path);
+		parseKtx2(file.data(), file.size());
+		return file;
+	}
+
+	int width, height, channels;
+	stbi_uc *pixels = stbi_load(path.c_str(), &width, &height, &channels, STBI_rgb_alpha);
+	VALIDATE(pixels, "Failed to load texture image: " + path);
+
+	list<uint8_t> file = writeKtx2(VK_FORMAT_R8G8B8A8_SRGB, static_cast<uint32_t>(width),
+								   static_cast<uint32_t>(height), pixels, static_cast<size_t>(width) * height * 4);
+	stbi_image_free(pixels);
+	return file;
+}
+
+static AssetType getAssetType(const std::string_view path) {
+	if (path.ends_with(".spv")) return AssetType::SpirV;
+
+	for (const std::string_view extension : {".png", ".jpg", ".jpeg", ".bmp", ".tga", ".ktx2"}) {
+		if (path.ends_with(extension)) return AssetType::Texture;
+	}
+	return AssetType::Script;
+}
+
+int main(const int argc, char **argv) {
+	if (argc < 3) {
+		LOGE("Usage: " << argv[0] << " <archive> <assets...>");
+		return EXIT_FAILURE;
+	}
+
+	try {
+		ArchiveWriter writer;
+		for (int i = 2; i < argc; ++i) {
+			const std::string path = argv[i];
+			const AssetType type = getAssetType(path);
+
+			switch (type) {
+			case AssetType::SpirV:
+				writer.add(path, type, packSpirV(path));
+				break;
+			case AssetType::Texture:
+				writer.add(path, type, packTexture(path));
+				break;
+			case AssetType::Script:
+				writer.add(path, type, readBytes(path));
+				break;
+			}
+			LOG("Packed " << path);
+		}
+
+		writer.write(argv[1]);
+	} catch (const std::exception &e) {
+		LOGE("Exception: " << e.what());
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
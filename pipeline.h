@@ -0,0 +1,111 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+#include <vulkan/vulkan.h>
+
+// Values match the BLEND_* constants of shader.frag
+enum class BlendMode : uint32_t {
+	Alpha = 0,
+	Additive = 1,
+	Premultiplied = 2,
+	Opaque = 3,
+};
+
+constexpr size_t BLEND_MODE_COUNT = 4;
+
+// Everything that makes two pipelines different, each distinct key is compiled once
+struct PipelineKey {
+	BlendMode blendMode = BlendMode::Alpha;
+	bool colorMultiply = false;
+	float uvScale = 1.0f;
+	bool alphaTest = false;
+	bool uvDebug = false;
+
+	bool operator==(const PipelineKey &) const = default;
+};
+
+template <> struct std::hash<PipelineKey> {
+	size_t operator()(const PipelineKey &key) const noexcept {
+		size_t seed = std::hash<uint32_t>{}(static_cast<uint32_t>(key.blendMode));
+		seed ^= std::hash<float>{}(key.uvScale) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		seed ^= (key.colorMultiply << 0) | (key.alphaTest << 1) | (key.uvDebug << 2);
+		return seed;
+	}
+};
+
+// Specialization constants of shader.frag, the map entries must follow the constant_id order
+struct ShaderConstants {
+	uint32_t blendMode;
+	VkBool32 colorMultiply;
+	float uvScale;
+	VkBool32 alphaTest;
+	VkBool32 uvDebug;
+};
+
+// Owns the data pointed to by the VkSpecializationInfo, so it must outlive the pipeline creation call
+struct PipelineSpecialization {
+	const ShaderConstants constants;
+	const std::array<VkSpecializationMapEntry, 5> entries{
+		VkSpecializationMapEntry{0, offsetof(ShaderConstants, blendMode), sizeof(uint32_t)},
+		VkSpecializationMapEntry{1, offsetof(ShaderConstants, colorMultiply), sizeof(VkBool32)},
+		VkSpecializationMapEntry{2, offsetof(ShaderConstants, uvScale), sizeof(float)},
+		VkSpecializationMapEntry{3, offsetof(ShaderConstants, alphaTest), sizeof(VkBool32)},
+		VkSpecializationMapEntry{4, offsetof(ShaderConstants, uvDebug), sizeof(VkBool32)},
+	};
+	const VkSpecializationInfo info{
+		.mapEntryCount = static_cast<uint32_t>(entries.size()),
+		.pMapEntries = entries.data(),
+		.dataSize = sizeof(ShaderConstants),
+		.pData = &constants,
+	};
+
+	explicit PipelineSpecialization(const PipelineKey &key)
+		: constants{
+			  .blendMode = static_cast<uint32_t>(key.blendMode),
+			  .colorMultiply = key.colorMultiply,
+			  .uvScale = key.uvScale,
+			  .alphaTest = key.alphaTest,
+			  .uvDebug = key.uvDebug,
+		  } {}
+
+	PipelineSpecialization(const PipelineSpecialization &) = delete;
+	PipelineSpecialization &operator=(const PipelineSpecialization &) = delete;
+};
+
+inline VkPipelineColorBlendAttachmentState getBlendAttachmentState(const BlendMode blendMode) {
+	// finalColor.rgb = newColor.rgb * srcFactor + oldColor.rgb * dstFactor
+	// finalColor.a = newColor.a * 1 + oldColor.a * 0
+	VkPipelineColorBlendAttachmentState state{
+		.blendEnable = VK_TRUE,
+
+		.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA,
+		.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA,
+		.colorBlendOp = VK_BLEND_OP_ADD,
+
+		.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE,
+		.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO,
+		.alphaBlendOp = VK_BLEND_OP_ADD,
+
+		.colorWriteMask =
+			VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT | VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT,
+	};
+
+	switch (blendMode) {
+	case BlendMode::Alpha:
+		break;
+	case BlendMode::Additive:
+		state.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		break;
+	case BlendMode::Premultiplied:
+		state.srcColorBlendFactor = VK_BLEND_FACTOR_ONE;
+		break;
+	case BlendMode::Opaque:
+		state.blendEnable = VK_FALSE;
+		break;
+	}
+	return state;
+}
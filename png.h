@@ -0,0 +1,106 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+#include "utils.h"
+
+// Minimal RGBA8 PNG encoder for captures and golden images. The image data uses stored (uncompressed) deflate
+// blocks, which keeps the encoder trivial and exact, at the cost of file size
+
+inline uint32_t crc32(const uint8_t *data, const size_t size, uint32_t crc = 0) {
+	static const std::array<uint32_t, 256> table = [] {
+		std::array<uint32_t, 256> table;
+		for (uint32_t i = 0; i < 256; ++i) {
+			uint32_t c = i;
+			for (int k = 0; k < 8; ++k) {
+				c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			}
+			table[i] = c;
+		}
+		return table;
+	}();
+
+	crc = ~crc;
+	for (size_t i = 0; i < size; ++i) {
+		crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	}
+	return ~crc;
+}
+
+inline void appendBigEndian(list<uint8_t> &out, const uint32_t value) {
+	out.push_back(static_cast<uint8_t>(value >> 24));
+	out.push_back(static_cast<uint8_t>(value >> 16));
+	out.push_back(static_cast<uint8_t>(value >> 8));
+	out.push_back(static_cast<uint8_t>(value));
+}
+
+inline void appendPngChunk(list<uint8_t> &out, const char type[4], const list<uint8_t> &data) {
+	appendBigEndian(out, static_cast<uint32_t>(data.size()));
+	const size_t typeOffset = out.size();
+	out.insert(out.end(), type, type + 4);
+	out.insert(out.end(), data.begin(), data.end());
+	appendBigEndian(out, crc32(out.data() + typeOffset, out.size() - typeOffset));
+}
+
+// Tightly packed rows of 4 bytes per pixel
+inline list<uint8_t> encodePng(const uint32_t width, const uint32_t height, const uint8_t *rgba) {
+	constexpr uint8_t SIGNATURE[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+	constexpr size_t MAX_STORED_BLOCK = 0xFFFF;
+
+	list<uint8_t> png(SIGNATURE, SIGNATURE + sizeof(SIGNATURE));
+
+	list<uint8_t> header;
+	appendBigEndian(header, width);
+	appendBigEndian(header, height);
+	// 8 bits per channel, RGBA, deflate, adaptive filtering, no interlace
+	header.insert(header.end(), {8, 6, 0, 0, 0});
+	appendPngChunk(png, "IHDR", header);
+
+	// Every row starts with its filter type, 0 for none
+	const size_t rowSize = static_cast<size_t>(width) * 4;
+	list<uint8_t> raw;
+	raw.reserve((rowSize + 1) * height);
+	for (uint32_t y = 0; y < height; ++y) {
+		raw.push_back(0);
+		raw.insert(raw.end(), rgba + y * rowSize, rgba + (y + 1) * rowSize);
+	}
+
+	// zlib header for deflate with a 32 KiB window, then stored blocks and the Adler-32 of the raw data
+	list<uint8_t> compressed = {0x78, 0x01};
+	compressed.reserve(raw.size() + raw.size() / MAX_STORED_BLOCK * 5 + 16);
+	size_t offset = 0;
+	do {
+		const size_t blockSize = std::min(raw.size() - offset, MAX_STORED_BLOCK);
+		const bool last = offset + blockSize == raw.size();
+		compressed.push_back(last ? 1 : 0);
+		compressed.push_back(static_cast<uint8_t>(blockSize));
+		compressed.push_back(static_cast<uint8_t>(blockSize >> 8));
+		compressed.push_back(static_cast<uint8_t>(~blockSize));
+		compressed.push_back(static_cast<uint8_t>(~blockSize >> 8));
+		compressed.insert(compressed.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+		offset += blockSize;
+	} while (offset < raw.size());
+
+	uint32_t a = 1, b = 0;
+	for (const uint8_t byte : raw) {
+		a = (a + byte) % 65521;
+		b = (b + a) % 65521;
+	}
+	appendBigEndian(compressed, b << 16 | a);
+	appendPngChunk(png, "IDAT", compressed);
+
+	appendPngChunk(png, "IEND", {});
+	return png;
+}
+
+inline bool writePng(const std::string &path, const uint32_t width, const uint32_t height, const uint8_t *rgba) {
+	const list<uint8_t> png = encodePng(width, height, rgba);
+
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char *>(png.data()), static_cast<std::streamsize>(png.size()));
+	return file.good();
+}
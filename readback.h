@@ -0,0 +1,174 @@
+#pragma once
+
+#include <atomic>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <utility>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+struct ReadbackFrame {
+	uint64_t id;
+	uint32_t slot;
+	VkExtent2D extent;
+	VkFormat format;
+	// Tightly packed rows of 4 bytes per pixel, valid until the slot is freed
+	const uint8_t *pixels;
+};
+
+// Swapchain images are usually BGRA, PNGs and the image decoder use RGBA
+inline list<uint8_t> toRgba(const uint8_t *pixels, const size_t pixelCount, const VkFormat format) {
+	list<uint8_t> rgba(pixels, pixels + pixelCount * 4);
+	if (format == VK_FORMAT_B8G8R8A8_SRGB || format == VK_FORMAT_B8G8R8A8_UNORM) {
+		for (size_t i = 0; i < pixelCount; ++i) {
+			std::swap(rgba[i * 4], rgba[i * 4 + 2]);
+		}
+	}
+	return rgba;
+}
+
+// Rendered images copied into the slots of a host visible buffer. A slot is only read once the timeline value of
+// the submission that filled it has completed, so the CPU never waits on the GPU for a capture, and a capture is
+// dropped rather than waited for when every slot is still in use. Consumers on other threads may hold on to a slot
+// and release it when they are done with the pixels
+class ReadbackRing {
+  public:
+	VkBuffer buffer = VK_NULL_HANDLE;
+
+	static VkDeviceSize getSlotSize(const VkExtent2D extent) {
+		return static_cast<VkDeviceSize>(extent.width) * extent.height * 4;
+	}
+
+	void create(const VkBuffer buffer, void *mapped, const VkDeviceSize slotSize, const uint32_t slotCount) {
+		VALIDATE(slotCount <= 32, "Too many readback slots!");
+		this->buffer = buffer;
+		data = static_cast<uint8_t *>(mapped);
+		this->slotSize = slotSize;
+		slots.assign(slotCount, Slot{});
+	}
+
+	// Records the copy of an image in TRANSFER_SRC_OPTIMAL layout into a free slot, followed by the barrier making
+	// it visible to the host. Empty when the capture has to be dropped
+	std::optional<uint32_t> record(const VkCommandBuffer commandBuffer, const VkImage image, const VkExtent2D extent,
+								   const VkFormat format, const uint64_t id) {
+		reclaimReleasedSlots();
+
+		uint32_t index = 0;
+		while (index < slots.size() && slots[index].state != SlotState::Free) {
+			++index;
+		}
+		if (index == slots.size() || getSlotSize(extent) > slotSize) {
+			++droppedCount;
+			return std::nullopt;
+		}
+
+		slots[index] = Slot{
+			.state = SlotState::Recorded,
+			.timelineValue = 0,
+			.id = id,
+			.extent = extent,
+			.format = format,
+		};
+
+		const VkBufferImageCopy region{
+			.bufferOffset = index * slotSize,
+			.bufferRowLength = 0,
+			.bufferImageHeight = 0,
+			.imageSubresource =
+				{
+					.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+					.mipLevel = 0,
+					.baseArrayLayer = 0,
+					.layerCount = 1,
+				},
+			.imageOffset = {0, 0, 0},
+			.imageExtent = {extent.width, extent.height, 1},
+		};
+		vkCmdCopyImageToBuffer(commandBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, buffer, 1, &region);
+
+		const VkBufferMemoryBarrier barrier{
+			.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER,
+			.pNext = VK_NULL_HANDLE,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT,
+			.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+			.buffer = buffer,
+			.offset = region.bufferOffset,
+			.size = getSlotSize(extent),
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+							 VK_NULL_HANDLE, 1, &barrier, 0, VK_NULL_HANDLE);
+		return index;
+	}
+
+	// Once the command buffer holding the copy is submitted with the timeline value
+	void submit(const uint32_t slot, const uint64_t timelineValue) {
+		slots[slot].state = SlotState::InFlight;
+		slots[slot].timelineValue = timelineValue;
+	}
+
+	// Hands every completed capture to onFrame, oldest first. The slot is freed right away unless onFrame returns
+	// true, in which case it stays held until release is called
+	template <typename F> void collect(const uint64_t completedValue, F &&onFrame) {
+		reclaimReleasedSlots();
+
+		while (true) {
+			Slot *oldest = nullptr;
+			for (Slot &slot : slots) {
+				if (slot.state == SlotState::InFlight && slot.timelineValue <= completedValue &&
+					(!oldest || slot.timelineValue < oldest->timelineValue)) {
+					oldest = &slot;
+				}
+			}
+			if (!oldest) return;
+
+			const uint32_t index = static_cast<uint32_t>(oldest - slots.data());
+			const bool held = onFrame(ReadbackFrame{
+				.id = oldest->id,
+				.slot = index,
+				.extent = oldest->extent,
+				.format = oldest->format,
+				.pixels = data + index * slotSize,
+			});
+			oldest->state = held ? SlotState::Held : SlotState::Free;
+		}
+	}
+
+	// Any thread, the slot is reused from the next record or collect on
+	void release(const uint32_t slot) { releasedSlots.fetch_or(1u << slot, std::memory_order_release); }
+
+	uint64_t getDroppedCount() const { return droppedCount; }
+
+  private:
+	enum class SlotState {
+		Free,
+		Recorded,
+		InFlight,
+		Held,
+	};
+
+	struct Slot {
+		SlotState state = SlotState::Free;
+		uint64_t timelineValue = 0;
+		uint64_t id = 0;
+		VkExtent2D extent = {0, 0};
+		VkFormat format = VK_FORMAT_UNDEFINED;
+	};
+
+	uint8_t *data = nullptr;
+	VkDeviceSize slotSize = 0;
+	list<Slot> slots;
+	uint64_t droppedCount = 0;
+	std::atomic<uint32_t> releasedSlots = 0;
+
+	void reclaimReleasedSlots() {
+		for (uint32_t released = releasedSlots.exchange(0, std::memory_order_acquire); released != 0;
+			 released &= released - 1) {
+			slots[std::countr_zero(released)].state = SlotState::Free;
+		}
+	}
+};
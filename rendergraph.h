@@ -0,0 +1,289 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+enum class ResourceUsage {
+	ColorAttachment,
+	Sampled,
+	TransferSrc,
+	TransferDst,
+	Present,
+};
+
+// Where and how an image is accessed, and the layout it has to be in for it
+struct UsageState {
+	VkPipelineStageFlags stage;
+	VkAccessFlags access;
+	VkImageLayout layout;
+};
+
+inline UsageState getUsageState(const ResourceUsage usage) {
+	switch (usage) {
+	case ResourceUsage::ColorAttachment:
+		return {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+				VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+	case ResourceUsage::Sampled:
+		return {VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+				VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+	case ResourceUsage::TransferSrc:
+		return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL};
+	case ResourceUsage::TransferDst:
+		return {VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL};
+	case ResourceUsage::Present:
+		return {VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR};
+	}
+	return {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED};
+}
+
+constexpr VkAccessFlags WRITE_ACCESS_MASK = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_TRANSFER_WRITE_BIT |
+											 VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT |
+											 VK_ACCESS_MEMORY_WRITE_BIT;
+
+inline bool isWriteAccess(const VkAccessFlags access) { return access & WRITE_ACCESS_MASK; }
+
+inline VkImageMemoryBarrier getImageBarrier(const VkImage image, const UsageState &from, const UsageState &to,
+											const uint32_t mipLevels = 1) {
+	return VkImageMemoryBarrier{
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.pNext = VK_NULL_HANDLE,
+		// Only writes have to be made available, reads after reads need no memory dependency
+		.srcAccessMask = from.access & WRITE_ACCESS_MASK,
+		.dstAccessMask = to.access,
+		.oldLayout = from.layout,
+		.newLayout = to.layout,
+		.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED,
+		.image = image,
+		.subresourceRange =
+			{
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.baseMipLevel = 0,
+				.levelCount = mipLevels,
+				.baseArrayLayer = 0,
+				.layerCount = 1,
+			},
+	};
+}
+
+struct ImageDesc {
+	VkFormat format;
+	VkExtent2D extent;
+	VkImageUsageFlags usage;
+	uint32_t mipLevels = 1;
+
+	bool operator==(const ImageDesc &other) const {
+		return format == other.format && extent.width == other.extent.width &&
+			   extent.height == other.extent.height && usage == other.usage && mipLevels == other.mipLevels;
+	}
+};
+
+// Passes declare which images they read and write, the graph derives the barriers and layout transitions between
+// them once at compile time, and lets transient images whose lifetimes do not overlap share the same VkImage
+class RenderGraph {
+  public:
+	using ResourceId = uint32_t;
+	using PassCallback = std::function<void(VkCommandBuffer)>;
+
+	// Images owned outside of the graph (e.g. swapchain images), their handle may change every frame
+	ResourceId importImage(const std::string &name, const UsageState &initialState, const ResourceUsage finalUsage) {
+		resources.push_back(Resource{
+			.name = name,
+			.imported = true,
+			.desc = {},
+			.initialState = initialState,
+			.finalUsage = finalUsage,
+		});
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	// Images only living during the frame, the contents are undefined before their first pass
+	ResourceId createTransient(const std::string &name, const ImageDesc &desc) {
+		resources.push_back(Resource{
+			.name = name,
+			.imported = false,
+			.desc = desc,
+			.initialState = {VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0, VK_IMAGE_LAYOUT_UNDEFINED},
+			.finalUsage = std::nullopt,
+		});
+		return static_cast<ResourceId>(resources.size() - 1);
+	}
+
+	void addPass(const std::string &name, const list<std::pair<ResourceId, ResourceUsage>> &reads,
+				 const list<std::pair<ResourceId, ResourceUsage>> &writes, PassCallback callback) {
+		Pass pass{.name = name, .accesses = {}, .callback = std::move(callback), .barriers = {}};
+		for (const auto &[id, usage] : reads) {
+			pass.accesses.push_back({id, usage});
+		}
+		for (const auto &[id, usage] : writes) {
+			pass.accesses.push_back({id, usage});
+		}
+		passes.push_back(std::move(pass));
+	}
+
+	void compile() {
+		assignPhysicalImages();
+
+		// Tracked per physical image so aliased transients also wait on the previous user of their memory
+		list<UsageState> states(resources.size());
+		list<bool> touched(resources.size(), false);
+		for (ResourceId id = 0; id < resources.size(); ++id) {
+			states[id] = resources[id].initialState;
+		}
+
+		for (Pass &pass : passes) {
+			pass.barriers.clear();
+			for (const auto &[id, usage] : pass.accesses) {
+				const ResourceId physical = physicalOf(id);
+				const UsageState next = getUsageState(usage);
+				UsageState &current = states[physical];
+
+				// A transient starts over from undefined contents when its lifetime begins
+				UsageState previous = current;
+				if (!resources[id].imported && !touched[id]) previous.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+				touched[id] = true;
+
+				const bool needsBarrier =
+					previous.layout != next.layout || isWriteAccess(previous.access) || isWriteAccess(next.access);
+				if (needsBarrier) {
+					pass.barriers.push_back({id, previous, next});
+					current = next;
+				} else {
+					current.stage |= next.stage;
+					current.access |= next.access;
+				}
+			}
+		}
+
+		finalBarriers.clear();
+		for (ResourceId id = 0; id < resources.size(); ++id) {
+			if (!resources[id].finalUsage) continue;
+
+			const UsageState next = getUsageState(*resources[id].finalUsage);
+			if (states[id].layout != next.layout || isWriteAccess(states[id].access)) {
+				finalBarriers.push_back({id, states[id], next});
+			}
+		}
+
+		LOG("Render graph compiled: " << passes.size() << " passes, " << physicalImages.size()
+									  << " physical transient images");
+	}
+
+	// Descriptions of the images the transients were merged into, the owner creates them and calls setPhysicalImage
+	const list<ImageDesc> &getPhysicalImages() const { return physicalImages; }
+
+	void setPhysicalImage(const size_t index, const VkImage image) {
+		for (ResourceId id = 0; id < resources.size(); ++id) {
+			if (!resources[id].imported && resources[id].physicalIndex == index) resources[id].image = image;
+		}
+	}
+
+	void setImage(const ResourceId id, const VkImage image) { resources[id].image = image; }
+
+	void execute(const VkCommandBuffer commandBuffer) {
+		for (const Pass &pass : passes) {
+			recordBarriers(commandBuffer, pass.barriers);
+			pass.callback(commandBuffer);
+		}
+		recordBarriers(commandBuffer, finalBarriers);
+	}
+
+  private:
+	struct Resource {
+		std::string name;
+		bool imported;
+		ImageDesc desc;
+		UsageState initialState;
+		std::optional<ResourceUsage> finalUsage;
+
+		size_t physicalIndex = 0;
+		VkImage image = VK_NULL_HANDLE;
+	};
+
+	struct Barrier {
+		ResourceId resource;
+		UsageState from, to;
+	};
+
+	struct Pass {
+		std::string name;
+		list<std::pair<ResourceId, ResourceUsage>> accesses;
+		PassCallback callback;
+		list<Barrier> barriers;
+	};
+
+	list<Resource> resources;
+	list<Pass> passes;
+	list<Barrier> finalBarriers;
+	list<ImageDesc> physicalImages;
+
+	// First transient sharing the physical image, used as the key for its tracked state
+	ResourceId physicalOf(const ResourceId id) const {
+		if (resources[id].imported) return id;
+
+		for (ResourceId other = 0; other < resources.size(); ++other) {
+			if (!resources[other].imported && resources[other].physicalIndex == resources[id].physicalIndex) {
+				return other;
+			}
+		}
+		return id;
+	}
+
+	void assignPhysicalImages() {
+		// Lifetime of every transient as the [first, last] pass index using it
+		list<std::pair<size_t, size_t>> lifetimes(resources.size(), {SIZE_MAX, 0});
+		for (size_t passIndex = 0; passIndex < passes.size(); ++passIndex) {
+			for (const auto &[id, usage] : passes[passIndex].accesses) {
+				lifetimes[id].first = std::min(lifetimes[id].first, passIndex);
+				lifetimes[id].second = std::max(lifetimes[id].second, passIndex);
+			}
+		}
+
+		physicalImages.clear();
+		list<size_t> physicalLastUse;
+		for (ResourceId id = 0; id < resources.size(); ++id) {
+			Resource &resource = resources[id];
+			if (resource.imported || lifetimes[id].first == SIZE_MAX) continue;
+
+			size_t slot = 0;
+			while (slot < physicalImages.size() &&
+				   !(physicalImages[slot] == resource.desc && physicalLastUse[slot] < lifetimes[id].first)) {
+				++slot;
+			}
+
+			if (slot == physicalImages.size()) {
+				physicalImages.push_back(resource.desc);
+				physicalLastUse.push_back(0);
+			}
+			physicalLastUse[slot] = lifetimes[id].second;
+			resource.physicalIndex = slot;
+		}
+	}
+
+	void recordBarriers(const VkCommandBuffer commandBuffer, const list<Barrier> &barriers) {
+		if (barriers.empty()) return;
+
+		// All the barriers of a pass are merged into a single call
+		VkPipelineStageFlags srcStage = 0, dstStage = 0;
+		imageBarriers.clear();
+		for (const Barrier &barrier : barriers) {
+			srcStage |= barrier.from.stage;
+			dstStage |= barrier.to.stage;
+			imageBarriers.push_back(getImageBarrier(resources[barrier.resource].image, barrier.from, barrier.to));
+		}
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, VK_NULL_HANDLE, 0, VK_NULL_HANDLE,
+							 static_cast<uint32_t>(imageBarriers.size()), imageBarriers.data());
+	}
+
+	list<VkImageMemoryBarrier> imageBarriers;
+};
@@ -1,15 +1,48 @@
 #version 450
 
-layout(location = 0) in vec3 fragColor;
+layout(location = 0) in vec4 fragColor;
 layout(location = 1) in vec2 fragTexCoord;
 
 layout(location = 0) out vec4 outColor;
 
 layout(binding = 1) uniform sampler2D texSampler;
 
+// Specialization constants, set per pipeline variant by PipelineKey
+const int BLEND_ALPHA = 0;
+const int BLEND_ADDITIVE = 1;
+const int BLEND_PREMULTIPLIED = 2;
+const int BLEND_OPAQUE = 3;
+
+layout(constant_id = 0) const int BLEND_MODE = BLEND_ALPHA;
+layout(constant_id = 1) const bool COLOR_MULTIPLY = false;
+layout(constant_id = 2) const float UV_SCALE = 1.0;
+layout(constant_id = 3) const bool ALPHA_TEST = false;
+layout(constant_id = 4) const bool UV_DEBUG = false;
+
+const float ALPHA_CUTOFF = 0.5;
+
 void main() {
-    // outColor = vec4(fragTexCoord, 0.0, 1.0);
-    outColor = texture(texSampler, fragTexCoord);
-    // outColor = texture(texSampler, fragTexCoord * 2.0);
-    // outColor = vec4(fragColor * texture(texSampler, fragTexCoord).rgb, 1.0);
+    if (UV_DEBUG) {
+        outColor = vec4(fragTexCoord, 0.0, 1.0);
+        return;
+    }
+
+    vec4 color = texture(texSampler, fragTexCoord * UV_SCALE);
+
+    if (COLOR_MULTIPLY) {
+        color *= fragColor;
+    }
+
+    if (ALPHA_TEST && color.a < ALPHA_CUTOFF) {
+        discard;
+    }
+
+    // Textures store straight alpha, premultiplied blending expects it applied here
+    if (BLEND_MODE == BLEND_PREMULTIPLIED) {
+        color.rgb *= color.a;
+    } else if (BLEND_MODE == BLEND_OPAQUE) {
+        color.a = 1.0;
+    }
+
+    outColor = color;
 }
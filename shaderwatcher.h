@@ -0,0 +1,132 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+struct CompiledShader {
+	std::string source;
+	VkShaderStageFlagBits stage;
+	// Empty when the compilation failed
+	list<uint32_t> code;
+	std::string log;
+};
+
+// Watches a shader directory with inotify and recompiles the GLSL sources written to it on its own thread, using the
+// same <name>_<stage>.spv outputs as the Makefile
+class ShaderWatcher {
+  public:
+	~ShaderWatcher() { stop(); }
+
+	bool start(const std::string &directory, const std::string &compiler) {
+		this->directory = directory;
+		this->compiler = compiler;
+
+		fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (fd < 0) return false;
+
+		// Editors either write the file in place or rename a temporary over it
+		if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+			close(fd);
+			fd = -1;
+			return false;
+		}
+
+		LOG("Watching " << directory << " for shader changes");
+		running = true;
+		thread = std::thread([this] { watch(); });
+		return true;
+	}
+
+	void stop() {
+		if (!thread.joinable()) return;
+
+		running = false;
+		thread.join();
+		close(fd);
+		fd = -1;
+	}
+
+	// Shaders compiled since the previous call
+	list<CompiledShader> takeCompiled() {
+		std::lock_guard lock(mutex);
+		return std::move(compiled);
+	}
+
+  private:
+	static constexpr int POLL_TIMEOUT_MS = 100;
+
+	std::string directory, compiler;
+	int fd = -1;
+	std::thread thread;
+	std::atomic<bool> running = false;
+
+	std::mutex mutex;
+	list<CompiledShader> compiled;
+
+	void watch() {
+		alignas(inotify_event) char buffer[4096];
+		pollfd pollInfo{.fd = fd, .events = POLLIN, .revents = 0};
+
+		while (running) {
+			if (poll(&pollInfo, 1, POLL_TIMEOUT_MS) <= 0) continue;
+
+			// A single save often produces several events, each file is compiled once per batch
+			std::set<std::string> changed;
+			ssize_t length;
+			while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+				for (char *event = buffer; event < buffer + length;) {
+					const auto *info = reinterpret_cast<const inotify_event *>(event);
+					if (info->len > 0) changed.insert(info->name);
+					event += sizeof(inotify_event) + info->len;
+				}
+			}
+
+			for (const std::string &name : changed) {
+				if (name.ends_with(".vert")) compile(name, VK_SHADER_STAGE_VERTEX_BIT, "_vert.spv");
+				if (name.ends_with(".frag")) compile(name, VK_SHADER_STAGE_FRAGMENT_BIT, "_frag.spv");
+			}
+		}
+	}
+
+	void compile(const std::string &name, const VkShaderStageFlagBits stage, const std::string &suffix) {
+		const std::string source = directory + "/" + name;
+		const std::string output = directory + "/" + name.substr(0, name.rfind('.')) + suffix;
+		LOG("Recompiling " << source);
+
+		CompiledShader shader{.source = source, .stage = stage, .code = {}, .log = {}};
+
+		const std::string command = compiler + " " + source + " -o " + output + " 2>&1";
+		FILE *process = popen(command.c_str(), "r");
+		if (!process) return;
+
+		char line[256];
+		while (fgets(line, sizeof(line), process)) {
+			shader.log += line;
+		}
+
+		if (pclose(process) == 0) {
+			std::ifstream file(output, std::ios::ate | std::ios::binary);
+			const size_t size = file.is_open() ? static_cast<size_t>(file.tellg()) : 0;
+			shader.code.resize(size / sizeof(uint32_t));
+			file.seekg(0);
+			file.read(reinterpret_cast<char *>(shader.code.data()), static_cast<std::streamsize>(size));
+		}
+
+		std::lock_guard lock(mutex);
+		compiled.push_back(std::move(shader));
+	}
+};
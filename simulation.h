@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+
+#include "bullets.h"
+#include "fixed.h"
+#include "input.h"
+
+constexpr uint32_t PLAYER_COUNT = 2;
+
+constexpr Fixed PLAYER_SPEED = Fixed::fromInt(4);
+constexpr Fixed PLAYER_FOCUS_SPEED = Fixed::fromInt(2);
+constexpr Fixed PLAYER_BULLET_SPEED = Fixed::fromInt(3);
+constexpr Fixed BOMB_BULLET_SPEED = Fixed::fromRatio(3, 2);
+constexpr uint32_t SHOT_INTERVAL = 4, BOMB_INTERVAL = 20, BOMB_BULLETS = 48;
+
+using TickInputs = std::array<InputState, PLAYER_COUNT>;
+
+// Everything the inputs of a tick act on. It only changes through step, all in fixed point, so two machines fed the
+// same inputs stay bit identical and a saved state can be restored to simulate again from there
+class Simulation {
+  public:
+	static constexpr size_t MAX_SNAPSHOT_SIZE =
+		sizeof(uint64_t) + sizeof(std::array<FixedVec2, PLAYER_COUNT>) + BulletSystem::MAX_SNAPSHOT_SIZE;
+
+	uint64_t getTick() const { return tick; }
+	const std::array<FixedVec2, PLAYER_COUNT> &getPlayers() const { return players; }
+	BulletSystem &getBullets() { return bullets; }
+
+	void step(const TickInputs &inputs) {
+		for (uint32_t player = 0; player < PLAYER_COUNT; ++player) {
+			const InputState input = inputs[player];
+			const Fixed speed = input.isHeld(Button::Focus) ? PLAYER_FOCUS_SPEED : PLAYER_SPEED;
+
+			FixedVec2 &position = players[player];
+			if (input.isHeld(Button::Left)) position.x -= speed;
+			if (input.isHeld(Button::Right)) position.x += speed;
+			if (input.isHeld(Button::Down)) position.y -= speed;
+			if (input.isHeld(Button::Up)) position.y += speed;
+			position.x = std::clamp(position.x, -PLAYFIELD_HALF_WIDTH, PLAYFIELD_HALF_WIDTH);
+			position.y = std::clamp(position.y, -PLAYFIELD_HALF_HEIGHT, PLAYFIELD_HALF_HEIGHT);
+
+			if (input.isHeld(Button::Shoot) && tick % SHOT_INTERVAL == 0) {
+				bullets.spawnAimed(position, players[(player + 1) % PLAYER_COUNT], PLAYER_BULLET_SPEED);
+			}
+			if (input.isHeld(Button::Bomb) && tick % BOMB_INTERVAL == 0) {
+				bullets.spawnRing(position, BOMB_BULLETS, static_cast<Angle>(tick * 1000), BOMB_BULLET_SPEED);
+			}
+		}
+
+		bullets.update();
+		++tick;
+	}
+
+	// Returns the snapshot size, at most MAX_SNAPSHOT_SIZE
+	size_t save(uint8_t *out) const {
+		uint8_t *end = out;
+		memcpy(end, &tick, sizeof(tick));
+		end += sizeof(tick);
+		memcpy(end, players.data(), sizeof(players));
+		end += sizeof(players);
+		return static_cast<size_t>(bullets.save(end) - out);
+	}
+
+	void restore(const uint8_t *in) {
+		memcpy(&tick, in, sizeof(tick));
+		in += sizeof(tick);
+		memcpy(players.data(), in, sizeof(players));
+		in += sizeof(players);
+		bullets.restore(in);
+	}
+
+	uint64_t getChecksum() const {
+		uint64_t hash = bullets.getChecksum() ^ tick;
+		for (const FixedVec2 &player : players) {
+			hash = (hash ^ static_cast<uint32_t>(player.x.raw)) * 0x100000001B3u;
+			hash = (hash ^ static_cast<uint32_t>(player.y.raw)) * 0x100000001B3u;
+		}
+		return hash;
+	}
+
+  private:
+	uint64_t tick = 0;
+	std::array<FixedVec2, PLAYER_COUNT> players = {
+		FixedVec2{Fixed::fromInt(0), Fixed::fromInt(-160)},
+		FixedVec2{Fixed::fromInt(0), Fixed::fromInt(160)},
+	};
+	BulletSystem bullets;
+};
@@ -0,0 +1,103 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <initializer_list>
+#include <memory>
+#include <type_traits>
+
+// list<T> keeping its first N elements inline, for the handful of items most Vulkan queries return. Past N it moves
+// to the heap like a list would. Elements are moved with memcpy, so only trivially copyable types fit
+template <typename T, size_t N> class small_list {
+	static_assert(std::is_trivially_copyable_v<T>, "small_list copies its elements with memcpy");
+	static_assert(N > 0);
+
+  public:
+	small_list() = default;
+	explicit small_list(const size_t count) { resize(count); }
+	small_list(const std::initializer_list<T> values) { assign(values.begin(), values.size()); }
+
+	small_list(const small_list &other) { assign(other.data(), other.count); }
+	small_list(small_list &&other) noexcept { take(other); }
+
+	small_list &operator=(const small_list &other) {
+		if (this != &other) assign(other.data(), other.count);
+		return *this;
+	}
+	small_list &operator=(small_list &&other) noexcept {
+		if (this != &other) take(other);
+		return *this;
+	}
+
+	size_t size() const { return count; }
+	size_t capacity() const { return heap ? heapCapacity : N; }
+	bool empty() const { return count == 0; }
+	// Whether the elements still fit inline, the list never allocated
+	bool isInline() const { return !heap; }
+
+	T *data() { return heap ? heap.get() : storage; }
+	const T *data() const { return heap ? heap.get() : storage; }
+	T *begin() { return data(); }
+	T *end() { return data() + count; }
+	const T *begin() const { return data(); }
+	const T *end() const { return data() + count; }
+
+	T &operator[](const size_t index) { return data()[index]; }
+	const T &operator[](const size_t index) const { return data()[index]; }
+	T &back() { return data()[count - 1]; }
+	const T &back() const { return data()[count - 1]; }
+
+	void reserve(const size_t newCapacity) {
+		if (newCapacity <= capacity()) return;
+
+		std::unique_ptr<T[]> newHeap(new T[newCapacity]);
+		memcpy(newHeap.get(), data(), count * sizeof(T));
+		heap = std::move(newHeap);
+		heapCapacity = newCapacity;
+	}
+
+	// New elements are value initialized, like in a list
+	void resize(const size_t newCount) {
+		reserve(newCount);
+		std::fill(data() + std::min(count, newCount), data() + newCount, T{});
+		count = newCount;
+	}
+
+	void push_back(const T &value) {
+		if (count == capacity()) reserve(capacity() * 2);
+		data()[count++] = value;
+	}
+
+	bool operator==(const small_list &other) const { return std::equal(begin(), end(), other.begin(), other.end()); }
+
+	void pop_back() { --count; }
+	// Keeps the capacity, heap or not
+	void clear() { count = 0; }
+
+  private:
+	T storage[N];
+	std::unique_ptr<T[]> heap;
+	size_t heapCapacity = 0;
+	size_t count = 0;
+
+	void assign(const T *values, const size_t valueCount) {
+		count = 0;
+		reserve(valueCount);
+		if (valueCount != 0) memcpy(data(), values, valueCount * sizeof(T));
+		count = valueCount;
+	}
+
+	// Steals the heap block, inline elements have to be copied. other is left empty, like a moved from list
+	void take(small_list &other) {
+		if (other.heap) {
+			heap = std::move(other.heap);
+			heapCapacity = other.heapCapacity;
+			count = other.count;
+			other.heapCapacity = 0;
+		} else {
+			assign(other.storage, other.count);
+		}
+		other.count = 0;
+	}
+};
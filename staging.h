@@ -0,0 +1,112 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <optional>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+// Persistently mapped upload buffer shared by every thread producing data for the GPU. Space is handed out in a
+// ring, and given back once the timeline value of the copy reading it has completed
+class StagingRing {
+  public:
+	static constexpr VkDeviceSize ALIGNMENT = 16;
+
+	struct Allocation {
+		VkDeviceSize offset, size;
+		uint8_t *data;
+	};
+
+	VkBuffer buffer = VK_NULL_HANDLE;
+
+	void create(const VkBuffer buffer, void *mapped, const VkDeviceSize capacity) {
+		this->buffer = buffer;
+		this->mapped = static_cast<uint8_t *>(mapped);
+		this->capacity = capacity;
+		closed = false;
+	}
+
+	VkDeviceSize getCapacity() const { return capacity; }
+
+	// Blocks until enough space has been given back, returns nothing if the request can never fit or the ring closed
+	std::optional<Allocation> allocate(const VkDeviceSize size) {
+		if (size > capacity) return std::nullopt;
+
+		std::unique_lock lock(mutex);
+		std::optional<VkDeviceSize> offset;
+		spaceAvailable.wait(lock, [&] { return closed || (offset = findSpace(size)); });
+		if (closed) return std::nullopt;
+
+		blocks.push_back(Block{*offset, size, IN_USE});
+		head = *offset + alignUp(size);
+		return Allocation{*offset, size, mapped + *offset};
+	}
+
+	// The allocation can be reused once the timeline reaches the value, 0 if it was never read by the GPU
+	void retire(const Allocation &allocation, const uint64_t timelineValue) {
+		std::lock_guard lock(mutex);
+		for (Block &block : blocks) {
+			if (block.offset == allocation.offset && block.retireValue == IN_USE) {
+				block.retireValue = timelineValue;
+				return;
+			}
+		}
+	}
+
+	void collect(const uint64_t completedValue) {
+		{
+			std::lock_guard lock(mutex);
+			const size_t count = blocks.size();
+			while (!blocks.empty() && blocks.front().retireValue <= completedValue) {
+				blocks.pop_front();
+			}
+			if (blocks.size() == count) return;
+			if (blocks.empty()) head = 0;
+		}
+		spaceAvailable.notify_all();
+	}
+
+	// Wakes up and fails every pending and future allocation
+	void close() {
+		{
+			std::lock_guard lock(mutex);
+			closed = true;
+		}
+		spaceAvailable.notify_all();
+	}
+
+  private:
+	static constexpr uint64_t IN_USE = UINT64_MAX;
+
+	struct Block {
+		VkDeviceSize offset, size;
+		uint64_t retireValue;
+	};
+
+	uint8_t *mapped = nullptr;
+	VkDeviceSize capacity = 0, head = 0;
+	std::deque<Block> blocks;
+	std::mutex mutex;
+	std::condition_variable spaceAvailable;
+	bool closed = false;
+
+	static VkDeviceSize alignUp(const VkDeviceSize size) { return (size + ALIGNMENT - 1) & ~(ALIGNMENT - 1); }
+
+	// Blocks are freed from the front, so the free space is after head, and before the oldest block once wrapped
+	std::optional<VkDeviceSize> findSpace(const VkDeviceSize size) const {
+		if (blocks.empty()) return 0;
+
+		const VkDeviceSize tail = blocks.front().offset;
+		if (head > tail) {
+			if (head + size <= capacity) return head;
+			if (size <= tail) return 0;
+			return std::nullopt;
+		}
+		if (head < tail && head + size <= tail) return head;
+		return std::nullopt;
+	}
+};
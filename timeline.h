@@ -0,0 +1,78 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include <vulkan/vulkan.h>
+
+#include "utils.h"
+
+// GPU progress tracked by a single VK_KHR_timeline_semaphore counter. Every submission (frames, uploads, compute)
+// signals the next value, so waiting on or reclaiming anything is a comparison against the value it was given
+class Timeline {
+  public:
+	VkSemaphore semaphore = VK_NULL_HANDLE;
+
+	void create(const VkDevice device) {
+		this->device = device;
+
+		vkWaitSemaphoresKHR = (PFN_vkWaitSemaphoresKHR)vkGetDeviceProcAddr(device, "vkWaitSemaphoresKHR");
+		vkGetSemaphoreCounterValueKHR =
+			(PFN_vkGetSemaphoreCounterValueKHR)vkGetDeviceProcAddr(device, "vkGetSemaphoreCounterValueKHR");
+		VALIDATE(vkWaitSemaphoresKHR && vkGetSemaphoreCounterValueKHR, "Missing timeline semaphore functions!");
+
+		const VkSemaphoreTypeCreateInfoKHR typeInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE_KHR,
+			.initialValue = 0,
+		};
+
+		const VkSemaphoreCreateInfo semaphoreInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+			.pNext = &typeInfo,
+			.flags = 0,
+		};
+
+		VK_CHECK(vkCreateSemaphore(device, &semaphoreInfo, VK_NULL_HANDLE, &semaphore),
+				 "Failed to create timeline semaphore!");
+	}
+
+	void destroy() { vkDestroySemaphore(device, semaphore, VK_NULL_HANDLE); }
+
+	// Value the next submission has to signal
+	uint64_t next() { return ++submittedValue; }
+
+	uint64_t lastSubmitted() const { return submittedValue; }
+
+	uint64_t completed() {
+		uint64_t value;
+		vkGetSemaphoreCounterValueKHR(device, semaphore, &value);
+		return completedValue = std::max(completedValue, value);
+	}
+
+	bool isComplete(const uint64_t value) { return value <= completedValue || value <= completed(); }
+
+	void wait(const uint64_t value) {
+		if (value <= completedValue) return;
+
+		const VkSemaphoreWaitInfoKHR waitInfo{
+			.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO_KHR,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.semaphoreCount = 1,
+			.pSemaphores = &semaphore,
+			.pValues = &value,
+		};
+
+		VK_CHECK(vkWaitSemaphoresKHR(device, &waitInfo, UINT64_MAX), "Failed to wait for timeline semaphore!");
+		completedValue = value;
+	}
+
+  private:
+	VkDevice device = VK_NULL_HANDLE;
+	uint64_t submittedValue = 0, completedValue = 0;
+
+	PFN_vkWaitSemaphoresKHR vkWaitSemaphoresKHR = VK_NULL_HANDLE;
+	PFN_vkGetSemaphoreCounterValueKHR vkGetSemaphoreCounterValueKHR = VK_NULL_HANDLE;
+};
@@ -13,8 +13,11 @@
 #define ERROR(x) throw std::runtime_error(x)
 #endif
 
+#include <memory_resource>
 #include <vector>
 template <typename T> using list = std::vector<T>;
+// Allocates from the memory resource it is constructed with, such as the frame arena
+template <typename T> using pmr_list = std::pmr::vector<T>;
 
 #define IS_STR_EQUAL(a, b) (strcmp(a, b) == 0)
 
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <vulkan/vulkan.h>
+
+// Full precision layout, 28 bytes per vertex
+struct Vertex {
+	glm::vec2 pos;
+	glm::vec3 color;
+	glm::vec2 texCoord;
+
+	static VkVertexInputBindingDescription getBindingDescription() {
+		return VkVertexInputBindingDescription{
+			.binding = 0,
+			.stride = sizeof(Vertex),
+			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+		};
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{
+			VkVertexInputAttributeDescription{
+				.location = 0,
+				.binding = 0,
+				.format = VK_FORMAT_R32G32_SFLOAT,
+				.offset = offsetof(Vertex, pos),
+			},
+			VkVertexInputAttributeDescription{
+				.location = 1,
+				.binding = 0,
+				.format = VK_FORMAT_R32G32B32_SFLOAT,
+				.offset = offsetof(Vertex, color),
+			},
+			VkVertexInputAttributeDescription{
+				.location = 2,
+				.binding = 0,
+				.format = VK_FORMAT_R32G32_SFLOAT,
+				.offset = offsetof(Vertex, texCoord),
+			},
+		};
+		return attributeDescriptions;
+	}
+};
+
+// Quantized layout, 12 bytes per vertex. The shader still sees floats: half positions and unorm
+// values are expanded by the input assembler, so both layouts share the same vertex shader
+struct PackedVertex {
+	uint32_t pos;      // R16G16_SFLOAT
+	uint32_t color;    // R8G8B8A8_UNORM
+	uint32_t texCoord; // R16G16_UNORM, texture coordinates must stay within [0, 1]
+
+	PackedVertex() = default;
+	PackedVertex(const glm::vec2 pos, const glm::vec3 color, const glm::vec2 texCoord)
+		: PackedVertex(pos, glm::vec4(color, 1.0f), texCoord) {}
+	PackedVertex(const glm::vec2 pos, const glm::vec4 color, const glm::vec2 texCoord)
+		: pos(glm::packHalf2x16(pos)), color(glm::packUnorm4x8(color)), texCoord(glm::packUnorm2x16(texCoord)) {}
+
+	static VkVertexInputBindingDescription getBindingDescription() {
+		return VkVertexInputBindingDescription{
+			.binding = 0,
+			.stride = sizeof(PackedVertex),
+			.inputRate = VK_VERTEX_INPUT_RATE_VERTEX,
+		};
+	}
+
+	static std::array<VkVertexInputAttributeDescription, 3> getAttributeDescriptions() {
+		std::array<VkVertexInputAttributeDescription, 3> attributeDescriptions{
+			VkVertexInputAttributeDescription{
+				.location = 0,
+				.binding = 0,
+				.format = VK_FORMAT_R16G16_SFLOAT,
+				.offset = offsetof(PackedVertex, pos),
+			},
+			VkVertexInputAttributeDescription{
+				.location = 1,
+				.binding = 0,
+				.format = VK_FORMAT_R8G8B8A8_UNORM,
+				.offset = offsetof(PackedVertex, color),
+			},
+			VkVertexInputAttributeDescription{
+				.location = 2,
+				.binding = 0,
+				.format = VK_FORMAT_R16G16_UNORM,
+				.offset = offsetof(PackedVertex, texCoord),
+			},
+		};
+		return attributeDescriptions;
+	}
+};
+
+static_assert(sizeof(Vertex) == 28);
+static_assert(sizeof(PackedVertex) == 12);
+
+// Vertex input state for any vertex type exposing getBindingDescription and getAttributeDescriptions,
+// so the layout is picked at compile time by the type the engine draws with
+template <typename V> struct VertexInputState {
+	const VkVertexInputBindingDescription binding = V::getBindingDescription();
+	const decltype(V::getAttributeDescriptions()) attributes = V::getAttributeDescriptions();
+
+	VkPipelineVertexInputStateCreateInfo createInfo() const {
+		return VkPipelineVertexInputStateCreateInfo{
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+			.pNext = VK_NULL_HANDLE,
+			.flags = 0,
+			.vertexBindingDescriptionCount = 1,
+			.pVertexBindingDescriptions = &binding,
+			.vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size()),
+			.pVertexAttributeDescriptions = attributes.data(),
+		};
+	}
+};